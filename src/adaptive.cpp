@@ -0,0 +1,312 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "adaptive.hpp"
+#include "huffman.hpp"
+#include "ngram.hpp"
+#include "util.hpp"
+
+namespace fs = std::filesystem;
+
+namespace txtz
+{
+    adaptive_codec::adaptive_codec(std::unordered_map<std::string, code> const &table,
+                                   txtz::normalization_t normalization,
+                                   options const &opts)
+        : opts_(opts), normalization_(normalization)
+    {
+        opts_.max_versions = std::max(opts_.max_versions, 1U);
+        versions_ = std::make_unique<std::atomic<txtz const *>[]>(opts_.max_versions);
+        for (uint32_t v = 0; v < opts_.max_versions; ++v)
+        {
+            versions_[v].store(nullptr, std::memory_order_relaxed);
+        }
+        // the destructor won't run if anything below throws, so the
+        // dictionaries stay owned here until the codec is complete
+        std::vector<std::unique_ptr<txtz>> loaded;
+        loaded.push_back(std::make_unique<txtz>(table, normalization_));
+        std::unordered_map<std::string, code> stored;
+        while (loaded.size() < opts_.max_versions && load(static_cast<uint32_t>(loaded.size()), stored))
+        {
+            loaded.push_back(std::make_unique<txtz>(stored, loaded.front()->framing(), normalization_));
+        }
+        for (uint32_t v = 0; v < loaded.size(); ++v)
+        {
+            versions_[v].store(loaded[v].get(), std::memory_order_relaxed);
+        }
+        current_.store(static_cast<uint32_t>(loaded.size() - 1), std::memory_order_release);
+        retrainer_ = std::thread(&adaptive_codec::run, this);
+        for (auto &z : loaded)
+        {
+            z.release();
+        }
+    }
+
+    adaptive_codec::~adaptive_codec()
+    {
+        {
+            std::lock_guard<std::mutex> lock(samples_mtx_);
+            stopped_ = true;
+        }
+        samples_cv_.notify_one();
+        retrainer_.join();
+        for (uint32_t v = 0; v < opts_.max_versions; ++v)
+        {
+            delete versions_[v].load(std::memory_order_relaxed);
+        }
+    }
+
+    txtz const &adaptive_codec::at(uint32_t version) const
+    {
+        if (version >= opts_.max_versions)
+            throw std::out_of_range("unknown dictionary version");
+        txtz const *z = versions_[version].load(std::memory_order_acquire);
+        if (z == nullptr)
+            throw std::out_of_range("unknown dictionary version");
+        return *z;
+    }
+
+    std::size_t adaptive_codec::compress_bound(std::size_t size) const
+    {
+        // retrained codes may be longer than those of version 0, so allow for the widest code there is
+        if (normalization_ == txtz::normalization_t::fold_case)
+        {
+            size *= 2;
+        }
+        return util::varint_size(opts_.max_versions) + util::varint_size(size) + (size + 1) * sizeof(code_t);
+    }
+
+    std::size_t adaptive_codec::compress(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const
+    {
+        if (opts_.sample_every > 0 && calls_.fetch_add(1, std::memory_order_relaxed) % opts_.sample_every == 0)
+        {
+            // never wait for the retrainer; if it holds the lock, this sample is skipped
+            std::unique_lock<std::mutex> lock(samples_mtx_, std::try_to_lock);
+            if (lock.owns_lock() && samples_.size() < opts_.retrain_after)
+            {
+                samples_.emplace_back(in);
+                if (samples_.size() == opts_.retrain_after)
+                {
+                    lock.unlock();
+                    samples_cv_.notify_one();
+                }
+            }
+        }
+        const uint32_t v = version();
+        const std::size_t header_size = util::write_varint(out, capacity, v);
+        if (header_size == 0)
+            throw std::length_error("output buffer too small");
+        const std::size_t size_out = at(v).compress(in, out + header_size, capacity - header_size, bits);
+        bits += 8 * header_size;
+        return header_size + size_out;
+    }
+
+    std::size_t adaptive_codec::decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const
+    {
+        std::size_t v;
+        const std::size_t header_size = util::read_varint(in, size, v);
+        if (header_size == 0 || v > version())
+            throw std::out_of_range("unknown dictionary version");
+        return at(static_cast<uint32_t>(v)).decompress(in + header_size, size - header_size, out, capacity);
+    }
+
+    void adaptive_codec::publish(std::unique_ptr<txtz> z)
+    {
+        const uint32_t v = version() + 1;
+        versions_[v].store(z.release(), std::memory_order_release);
+        current_.store(v, std::memory_order_release);
+    }
+
+    void adaptive_codec::run()
+    {
+        std::vector<std::string> samples;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(samples_mtx_);
+                samples_cv_.wait(lock, [this]
+                                 { return stopped_ || samples_.size() >= opts_.retrain_after; });
+                if (stopped_)
+                    return;
+                samples.swap(samples_);
+                samples_.clear();
+            }
+            if (version() + 1 >= opts_.max_versions)
+                continue;
+            retrainings_.fetch_add(1, std::memory_order_relaxed);
+            try
+            {
+                auto z = retrain(samples);
+                if (z)
+                {
+                    save(version() + 1, z->table());
+                    publish(std::move(z));
+                }
+            }
+            catch (std::exception const &)
+            {
+                // keep the current dictionary if retraining or saving fails
+            }
+        }
+    }
+
+    std::unique_ptr<txtz> adaptive_codec::retrain(std::vector<std::string> const &samples) const
+    {
+        txtz const &current = at(version());
+        std::unordered_map<std::string, std::size_t> counts;
+        std::size_t strings = 0;
+        for (auto const &s : samples)
+        {
+            try
+            {
+                current.count_tokens(s, counts);
+                ++strings;
+            }
+            catch (std::invalid_argument const &)
+            {
+                // strings that can't be compressed don't tell anything
+            }
+        }
+        if (current.framing() == txtz::framing_t::stop_token && strings > 0)
+        {
+            counts[std::string(&txtz::STOP_TOKEN, 1)] += strings;
+        }
+        std::size_t total = 0;
+        for (auto const &it : counts)
+        {
+            total += it.second;
+        }
+        if (total == 0)
+            return nullptr;
+
+        // mix observed frequencies into the probabilities implied by the current code lengths,
+        // so that tokens not seen in the samples keep a code
+        std::vector<ngram_t> ngrams;
+        ngrams.reserve(current.table().size());
+        for (auto const &it : current.table())
+        {
+            auto const found = counts.find(it.first);
+            const double observed = found == std::end(counts) ? 0.0 : double(found->second) / double(total);
+            const double implied = std::ldexp(1.0, -static_cast<int>(it.second.bitcount()));
+            ngrams.push_back(ngram_t{it.first, static_cast<float>((1 - opts_.learning_rate) * implied + opts_.learning_rate * observed)});
+        }
+        huffman(ngrams);
+
+        std::unordered_map<std::string, code> table;
+        table.reserve(ngrams.size());
+        std::size_t old_bits = 0;
+        std::size_t new_bits = 0;
+        for (auto const &ngram : ngrams)
+        {
+            table.emplace(ngram.token, ngram.c.reversed());
+            auto const found = counts.find(ngram.token);
+            if (found != std::end(counts))
+            {
+                old_bits += found->second * current.table().at(ngram.token).bitcount();
+                new_bits += found->second * ngram.c.bitcount();
+            }
+        }
+        if (new_bits >= old_bits)
+            return nullptr;
+        return std::make_unique<txtz>(table, current.framing(), normalization_);
+    }
+
+    std::string adaptive_codec::filename(uint32_t version) const
+    {
+        return (fs::path(opts_.state_dir) / ("txtz-dict-" + std::to_string(version) + ".txt")).string();
+    }
+
+    /**
+     * One line per token: code length, code in hex, token bytes in hex.
+     * The token goes last because it may be empty.
+     */
+    void adaptive_codec::save(uint32_t version, std::unordered_map<std::string, code> const &table) const
+    {
+        if (opts_.state_dir.empty())
+            return;
+        const std::string name = filename(version);
+        const std::string tmp_name = name + ".tmp";
+        {
+            std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+            out << std::setfill('0');
+            for (auto const &it : table)
+            {
+                out << std::dec << it.second.bitcount() << ' ' << std::hex << it.second.bits() << ' ';
+                for (char c : it.first)
+                {
+                    out << std::setw(2) << static_cast<unsigned int>(static_cast<uint8_t>(c));
+                }
+                out << '\n';
+            }
+            if (!out)
+                throw std::runtime_error("cannot write " + tmp_name);
+        }
+        fs::rename(tmp_name, name);
+    }
+
+    bool adaptive_codec::load(uint32_t version, std::unordered_map<std::string, code> &table) const
+    {
+        if (opts_.state_dir.empty())
+            return false;
+        std::ifstream in(filename(version), std::ios::binary);
+        if (!in)
+            return false;
+        table.clear();
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream iss(line);
+            std::string hex;
+            unsigned long length;
+            code_t bits;
+            if (!(iss >> std::dec >> length >> std::hex >> bits) || length == 0 || length > 8 * sizeof(code_t))
+                throw std::runtime_error("malformed dictionary " + filename(version));
+            iss >> hex;
+            if (hex.size() % 2 != 0)
+                throw std::runtime_error("malformed dictionary " + filename(version));
+            if (!std::all_of(std::begin(hex), std::end(hex), [](unsigned char c)
+                             { return std::isxdigit(c) != 0; }))
+                throw std::runtime_error("malformed dictionary " + filename(version));
+            std::string token;
+            for (std::size_t i = 0; i < hex.size(); i += 2)
+            {
+                token.push_back(static_cast<char>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+            }
+            table.emplace(std::move(token), code(length, bits));
+        }
+        return true;
+    }
+}
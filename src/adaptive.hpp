@@ -0,0 +1,169 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __ADAPTIVE_HPP__
+#define __ADAPTIVE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "code.hpp"
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * A codec that adapts its codes to the data it sees.
+     *
+     * Every `sample_every`th string passed to `compress()` is kept as a
+     * sample. A background thread splits the samples into tokens, mixes
+     * the observed token frequencies into the probabilities implied by the
+     * current code lengths and builds new Huffman codes for the same set of
+     * tokens. If the new codes need fewer bits for the samples, they are
+     * published as the next dictionary version.
+     *
+     * All versions are kept, so publishing is a single atomic store and
+     * readers never wait. Compressed data starts with the version of the
+     * dictionary it was compressed with (LEB128 varint), so data compressed
+     * with an older version stays decodable. If `state_dir` is given,
+     * retrained dictionaries are stored there and reloaded on start.
+     */
+    class adaptive_codec final
+    {
+    public:
+        struct options
+        {
+            /**
+             * Keep one out of this many strings as a sample.
+             */
+            std::size_t sample_every{16};
+            /**
+             * Retrain once this many samples have been collected.
+             */
+            std::size_t retrain_after{10000};
+            /**
+             * Weight of the observed frequencies against the current code lengths, 0..1.
+             */
+            double learning_rate{0.5};
+            /**
+             * Stop retraining when this many versions exist.
+             */
+            uint32_t max_versions{256};
+            /**
+             * Directory to keep retrained dictionaries in; empty to keep them in memory only.
+             */
+            std::string state_dir;
+        };
+
+        /**
+         * @param table code table of version 0
+         * @throw std::runtime_error if a stored dictionary can't be loaded
+         */
+        adaptive_codec(std::unordered_map<std::string, code> const &table,
+                       txtz::normalization_t normalization,
+                       options const &opts);
+        adaptive_codec(adaptive_codec const &) = delete;
+        adaptive_codec &operator=(adaptive_codec const &) = delete;
+        ~adaptive_codec();
+
+        /**
+         * Compress with the current dictionary, see `txtz::compress()`.
+         */
+        std::size_t compress(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const;
+
+        std::size_t compress_bound(std::size_t size) const;
+
+        /**
+         * Decompress with the dictionary whose version the data starts with.
+         *
+         * @throw std::out_of_range if the version is unknown or the data is corrupt
+         * @throw std::length_error if `out` is too small
+         */
+        std::size_t decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const;
+
+        /**
+         * @return version of the dictionary `compress()` currently uses
+         */
+        uint32_t version() const
+        {
+            return current_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @return number of retraining rounds, whether or not they led to a new version
+         */
+        uint64_t retrainings() const
+        {
+            return retrainings_.load(std::memory_order_relaxed);
+        }
+
+        std::size_t max_token_length() const
+        {
+            return versions_[0].load(std::memory_order_relaxed)->max_token_length();
+        }
+
+    private:
+        options opts_;
+        txtz::normalization_t normalization_;
+        /**
+         * One slot per version, filled once and never changed afterwards.
+         */
+        std::unique_ptr<std::atomic<txtz const *>[]> versions_;
+        std::atomic<uint32_t> current_{0};
+        std::atomic<uint64_t> retrainings_{0};
+
+        mutable std::atomic<uint64_t> calls_{0};
+        mutable std::mutex samples_mtx_;
+        mutable std::condition_variable samples_cv_;
+        mutable std::vector<std::string> samples_;
+        bool stopped_{false};
+        std::thread retrainer_;
+
+        txtz const &at(uint32_t version) const;
+        void publish(std::unique_ptr<txtz> z);
+        void run();
+        /**
+         * @return new codec if it beats the current one on `samples`, nullptr otherwise
+         */
+        std::unique_ptr<txtz> retrain(std::vector<std::string> const &samples) const;
+        std::string filename(uint32_t version) const;
+        void save(uint32_t version, std::unordered_map<std::string, code> const &table) const;
+        bool load(uint32_t version, std::unordered_map<std::string, code> &table) const;
+    };
+}
+
+#endif // __ADAPTIVE_HPP__
@@ -0,0 +1,295 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "batch.hpp"
+#include "huffman.hpp"
+#include "ngram.hpp"
+#include "util.hpp"
+
+namespace txtz
+{
+    namespace
+    {
+        constexpr std::size_t FULL_KRAFT_SUM = std::size_t(1) << batch_codec::MAX_CODE_LENGTH;
+
+        void append_uint32(std::vector<uint8_t> &out, std::size_t value)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                out.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        }
+
+        std::size_t read_uint32(uint8_t const *in)
+        {
+            return std::size_t(in[0]) | std::size_t(in[1]) << 8 | std::size_t(in[2]) << 16 | std::size_t(in[3]) << 24;
+        }
+
+        /**
+         * Share of the code space taken by a code of `length` bits, in units of 2^-MAX_CODE_LENGTH.
+         */
+        std::size_t kraft_share(unsigned long length)
+        {
+            return std::size_t(1) << (batch_codec::MAX_CODE_LENGTH - length);
+        }
+
+        /**
+         * Limit the Huffman code lengths of `ngrams`, sorted by ascending
+         * weight, to `MAX_CODE_LENGTH` bits: cut longer codes, then lengthen
+         * the codes of the lightest tokens below the limit until the code
+         * is prefix free again, and finally shorten the codes of the
+         * heaviest tokens as far as the freed code space allows.
+         */
+        std::vector<unsigned long> limited_lengths(std::vector<ngram_t> const &ngrams)
+        {
+            std::vector<unsigned long> lengths(ngrams.size());
+            std::size_t kraft_sum = 0;
+            for (std::size_t i = 0; i < ngrams.size(); ++i)
+            {
+                lengths[i] = std::min(ngrams[i].c.bitcount(), batch_codec::MAX_CODE_LENGTH);
+                kraft_sum += kraft_share(lengths[i]);
+            }
+            while (kraft_sum > FULL_KRAFT_SUM)
+            {
+                auto const it = std::find_if(std::begin(lengths), std::end(lengths), [](unsigned long length)
+                                             { return length < batch_codec::MAX_CODE_LENGTH; });
+                kraft_sum -= kraft_share(*it + 1);
+                ++*it;
+            }
+            for (std::size_t i = lengths.size(); i-- > 0;)
+            {
+                while (lengths[i] > 1 && kraft_sum + kraft_share(lengths[i]) <= FULL_KRAFT_SUM)
+                {
+                    kraft_sum += kraft_share(lengths[i]);
+                    --lengths[i];
+                }
+            }
+            return lengths;
+        }
+    }
+
+    std::string batch_codec::batch::at(std::size_t index) const
+    {
+        if (index >= count_)
+            throw std::out_of_range("no such string");
+        std::size_t pos = read_uint32(offsets_ + 4 * (index / INDEX_INTERVAL));
+        for (std::size_t i = index - index % INDEX_INTERVAL;; ++i)
+        {
+            if (pos > strings_size_)
+                throw std::out_of_range("invalid string offset");
+            std::size_t size;
+            const std::size_t header_size = util::read_varint(strings_ + pos, strings_size_ - pos, size);
+            if (header_size == 0 || size > strings_size_ - pos - header_size)
+                throw std::out_of_range("invalid string size");
+            pos += header_size;
+            if (i == index)
+                return z_.decompress(std::vector<uint8_t>(strings_ + pos, strings_ + pos + size));
+            pos += size;
+        }
+    }
+
+    batch_codec::batch_codec(txtz const &z)
+        : z_(z)
+    {
+        tokens_.reserve(z_.table().size());
+        for (auto const &it : z_.table())
+        {
+            tokens_.push_back(it.first);
+        }
+        std::sort(std::begin(tokens_), std::end(tokens_));
+    }
+
+    std::unordered_map<std::string, code> batch_codec::canonical_codes(std::vector<unsigned long> const &lengths) const
+    {
+        std::vector<std::size_t> order;
+        for (std::size_t i = 0; i < lengths.size(); ++i)
+        {
+            if (lengths[i] > 0)
+            {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(std::begin(order), std::end(order), [&lengths](std::size_t a, std::size_t b)
+                         { return lengths[a] < lengths[b]; });
+        std::unordered_map<std::string, code> table;
+        table.reserve(order.size());
+        code_t bits = 0;
+        unsigned long prev_length = order.empty() ? 0 : lengths[order.front()];
+        for (std::size_t i : order)
+        {
+            bits <<= (lengths[i] - prev_length);
+            prev_length = lengths[i];
+            code c;
+            for (unsigned long b = lengths[i]; b-- > 0;)
+            {
+                c.append(((bits >> b) & 1) != 0);
+            }
+            table.emplace(tokens_[i], c.reversed());
+            ++bits;
+        }
+        return table;
+    }
+
+    std::vector<uint8_t> batch_codec::compress(std::vector<std::string_view> const &strings, std::size_t &bits) const
+    {
+        if (strings.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("too many strings for a batch");
+        std::unordered_map<std::string, std::size_t> counts;
+        for (auto const &s : strings)
+        {
+            z_.count_tokens(s, counts);
+        }
+        if (z_.framing() == txtz::framing_t::stop_token && !strings.empty())
+        {
+            counts[std::string(&txtz::STOP_TOKEN, 1)] += strings.size();
+        }
+        std::vector<ngram_t> ngrams;
+        ngrams.reserve(counts.size());
+        for (auto const &it : counts)
+        {
+            ngrams.push_back(ngram_t{it.first, static_cast<float>(it.second)});
+        }
+        huffman(ngrams);
+        const std::vector<unsigned long> limited = limited_lengths(ngrams);
+        std::vector<unsigned long> lengths(tokens_.size(), 0);
+        for (std::size_t i = 0; i < ngrams.size(); ++i)
+        {
+            auto const it = std::lower_bound(std::begin(tokens_), std::end(tokens_), ngrams[i].token);
+            lengths[static_cast<std::size_t>(it - std::begin(tokens_))] = limited[i];
+        }
+
+        std::vector<uint8_t> out;
+        util::append_varint(out, ngrams.size());
+        std::size_t gap = 0;
+        for (auto length : lengths)
+        {
+            if (length == 0)
+            {
+                ++gap;
+                continue;
+            }
+            util::append_varint(out, gap << 4 | length);
+            gap = 0;
+        }
+        const std::size_t header_size = out.size();
+        bits = 8 * header_size;
+
+        // without any tokens, all strings are empty and the dictionary's own codes do
+        const txtz z = ngrams.empty() ? z_ : txtz(canonical_codes(lengths), z_.framing(), z_.normalization());
+        std::vector<std::size_t> offsets;
+        std::size_t n = 0;
+        std::vector<uint8_t> buf;
+        for (auto const &s : strings)
+        {
+            if (offsets.size() * INDEX_INTERVAL == n)
+            {
+                offsets.push_back(out.size() - header_size);
+            }
+            ++n;
+            buf.resize(z.compress_bound(s.size()));
+            std::size_t string_bits;
+            const std::size_t size = z.compress(s, buf.data(), buf.size(), string_bits);
+            const std::size_t prefix_size = util::varint_size(size);
+            bits += 8 * prefix_size + string_bits;
+            util::append_varint(out, size);
+            out.insert(std::end(out), std::begin(buf), std::begin(buf) + static_cast<std::ptrdiff_t>(size));
+        }
+        if (out.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("batch too large");
+        for (auto offset : offsets)
+        {
+            append_uint32(out, offset);
+        }
+        append_uint32(out, strings.size());
+        bits += 32 * (offsets.size() + 1);
+        return out;
+    }
+
+    batch_codec::batch batch_codec::open(uint8_t const *in, std::size_t size) const
+    {
+        if (size < 4)
+            throw std::out_of_range("batch truncated");
+        const std::size_t count = read_uint32(in + size - 4);
+        const std::size_t index_size = count / INDEX_INTERVAL + (count % INDEX_INTERVAL != 0);
+        // every string takes at least one byte
+        if (count > size - 4 || index_size > (size - 4 - count) / 4)
+            throw std::out_of_range("batch truncated");
+        const std::size_t end = size - 4 - 4 * index_size;
+        std::size_t pos = 0;
+        std::size_t used;
+        std::size_t n = util::read_varint(in, end, used);
+        if (n == 0 || used > tokens_.size())
+            throw std::out_of_range("invalid batch header");
+        pos += n;
+        std::vector<unsigned long> lengths(tokens_.size(), 0);
+        std::size_t kraft_sum = 0;
+        for (std::size_t i = 0, token = 0; i < used; ++i, ++token)
+        {
+            std::size_t entry;
+            n = util::read_varint(in + pos, end - pos, entry);
+            if (n == 0)
+                throw std::out_of_range("invalid batch header");
+            pos += n;
+            const unsigned long length = entry & 0xf;
+            if ((entry >> 4) >= tokens_.size() - std::min(token, tokens_.size()) || length == 0)
+                throw std::out_of_range("invalid batch header");
+            token += entry >> 4;
+            lengths[token] = length;
+            kraft_sum += kraft_share(length);
+        }
+        if (kraft_sum > FULL_KRAFT_SUM)
+            throw std::out_of_range("batch code isn't prefix free");
+        if (used == 0)
+            return batch(z_, in + pos, end - pos, in + end, count);
+        try
+        {
+            return batch(txtz(canonical_codes(lengths), z_.framing(), z_.normalization()), in + pos, end - pos, in + end, count);
+        }
+        catch (std::invalid_argument const &)
+        {
+            throw std::out_of_range("batch code lacks the stop token");
+        }
+    }
+
+    std::vector<std::string> batch_codec::decompress(uint8_t const *in, std::size_t size) const
+    {
+        const batch b = open(in, size);
+        std::vector<std::string> strings;
+        strings.reserve(b.size());
+        for (std::size_t i = 0; i < b.size(); ++i)
+        {
+            strings.push_back(b.at(i));
+        }
+        return strings;
+    }
+}
@@ -0,0 +1,149 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __BATCH_HPP__
+#define __BATCH_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "code.hpp"
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * Compresses a batch of strings with codes made for the batch
+     * (semi-static coding). The strings are split into tokens of the
+     * dictionary they are given, the tokens are counted, and a canonical
+     * Huffman code of at most `MAX_CODE_LENGTH` bits is built for the
+     * tokens found. As codes of equal length are consecutive numbers in
+     * canonical codes, the code lengths suffice to rebuild the codes:
+     *
+     *     header | string 0 | ... | string n-1 | offset 0 | ... | offset r-1 | n
+     *
+     * The header is the number of tokens used, followed by one LEB128
+     * varint per used token, in byte-wise order of the tokens, holding
+     * the number of unused tokens skipped since the previous one shifted
+     * left by four bits and the code length in the low four bits. Each
+     * string is compressed on its own with these codes and preceded by
+     * its compressed size as varint, so that any of them can be decoded
+     * after reading the header. The offsets (from the end of the header)
+     * of every `INDEX_INTERVAL`th string and `n` are 32 bit little endian
+     * numbers.
+     */
+    class batch_codec final
+    {
+    public:
+        static constexpr unsigned long MAX_CODE_LENGTH = 15;
+        static constexpr std::size_t INDEX_INTERVAL = 16;
+
+        /**
+         * A compressed batch with its codes rebuilt from the header.
+         */
+        class batch final
+        {
+        public:
+            std::size_t size() const
+            {
+                return count_;
+            }
+
+            /**
+             * Decode string number `index` only, skipping at most
+             * `INDEX_INTERVAL - 1` strings before it.
+             *
+             * @throw std::out_of_range if there's no such string or the compressed data is corrupt
+             */
+            std::string at(std::size_t index) const;
+
+            /**
+             * @return the dictionary holding the codes of the batch
+             */
+            txtz const &codes() const
+            {
+                return z_;
+            }
+
+        private:
+            friend class batch_codec;
+
+            batch(txtz z, uint8_t const *strings, std::size_t strings_size, uint8_t const *offsets, std::size_t count)
+                : z_(std::move(z)), strings_(strings), strings_size_(strings_size), offsets_(offsets), count_(count) {}
+
+            txtz z_;
+            uint8_t const *strings_;
+            std::size_t strings_size_;
+            uint8_t const *offsets_;
+            std::size_t count_;
+        };
+
+        /**
+         * Use the tokens, framing and normalization of `z`.
+         */
+        explicit batch_codec(txtz const &z);
+
+        /**
+         * @param bits receives the number of bits written, including header and offsets
+         * @throw std::invalid_argument if a string contains a character without code in the dictionary
+         * @throw std::length_error if there are 2^32 strings or more, or the result exceeds 4 GiB
+         */
+        std::vector<uint8_t> compress(std::vector<std::string_view> const &strings, std::size_t &bits) const;
+
+        /**
+         * Read the header and rebuild the codes. The batch refers to
+         * `in`, which must outlive it.
+         *
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        batch open(uint8_t const *in, std::size_t size) const;
+
+        /**
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        std::vector<std::string> decompress(uint8_t const *in, std::size_t size) const;
+
+    private:
+        txtz z_;
+        /**
+         * All tokens of the dictionary in byte-wise order.
+         */
+        std::vector<std::string> tokens_;
+
+        /**
+         * Assign canonical codes to the tokens with the given lengths (0 for unused tokens).
+         */
+        std::unordered_map<std::string, code> canonical_codes(std::vector<unsigned long> const &lengths) const;
+    };
+}
+
+#endif // __BATCH_HPP__
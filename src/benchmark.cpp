@@ -0,0 +1,803 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bintree.hpp"
+#include "bitio.hpp"
+#include "getopt.hpp"
+#include "huffman.hpp"
+#include "mappings.hpp"
+#include "multitable.hpp"
+#include "ngram.hpp"
+#include "shannon-fano.hpp"
+#include "text.hpp"
+#include "txtz.hpp"
+
+namespace
+{
+    typedef enum
+    {
+        INVALID_BENCHMARK,
+        CODES,
+        SCALING,
+        CODERS,
+        ALGORITHMS,
+        CORRUPT,
+        TEXT,
+    } benchmark_t;
+
+    /**
+     * Generate `n` n-grams with Zipf-distributed weights, i.e. the
+     * weight of the n-gram at rank r is proportional to 1/r^s, in random order.
+     */
+    std::vector<txtz::ngram_t> zipf_vocabulary(std::size_t n, double s, std::mt19937 &rng)
+    {
+        std::vector<txtz::ngram_t> ngrams(n);
+        for (std::size_t r = 0; r < n; ++r)
+        {
+            ngrams[r].weight = static_cast<float>(1e9 / std::pow(static_cast<double>(r + 1), s));
+        }
+        std::shuffle(std::begin(ngrams), std::end(ngrams), rng);
+        return ngrams;
+    }
+
+    /**
+     * Time code construction for vocabularies of `min_tokens` to
+     * `max_tokens` n-grams, growing by a factor of 10.
+     */
+    void benchmark_codes(std::string const &algo, std::size_t min_tokens, std::size_t max_tokens, double zipf_exponent)
+    {
+        std::mt19937 rng(4711);
+        std::cout << "Building " << algo << " codes for Zipf-distributed vocabularies (s = " << zipf_exponent << ")\n\n"
+                  << std::setw(10) << "tokens"
+                  << std::setw(12) << "time/ms"
+                  << std::setw(14) << "Mtokens/s"
+                  << std::setw(12) << "avg. bits"
+                  << std::setw(10) << "max bits"
+                  << std::setw(10) << "Kraft" << '\n';
+        for (std::size_t n = min_tokens; n <= max_tokens; n *= 10)
+        {
+            auto ngrams = zipf_vocabulary(n, zipf_exponent, rng);
+            const auto t0 = std::chrono::steady_clock::now();
+            if (algo == "shannon-fano")
+            {
+                txtz::shannon_fano(ngrams);
+            }
+            else
+            {
+                txtz::huffman(ngrams);
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+            const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            double total_weight = 0;
+            double weighted_bits = 0;
+            double kraft = 0;
+            unsigned long max_bits = 0;
+            for (auto const &ngram : ngrams)
+            {
+                total_weight += ngram.weight;
+                weighted_bits += double(ngram.weight) * double(ngram.c.bitcount());
+                kraft += std::ldexp(1.0, -static_cast<int>(ngram.c.bitcount()));
+                max_bits = std::max(max_bits, ngram.c.bitcount());
+            }
+            std::cout << std::setw(10) << n
+                      << std::setw(12) << std::fixed << std::setprecision(1) << ms
+                      << std::setw(14) << std::setprecision(2) << 1e-3 * double(n) / ms
+                      << std::setw(12) << std::setprecision(3) << weighted_bits / total_weight
+                      << std::setw(10) << max_bits
+                      << std::setw(10) << std::setprecision(6) << kraft << '\n';
+        }
+    }
+
+    /**
+     * Compress and decompress all `strings` `repeat` times with a copy of
+     * the handle `z` and return the number of mismatching round trips.
+     * All buffers are allocated up front, so the loop itself only reads
+     * the shared dictionary and writes to memory owned by this thread.
+     */
+    std::size_t round_trip(txtz::txtz const z, std::vector<std::string> const &strings, std::size_t repeat)
+    {
+        std::size_t max_size = 0;
+        for (auto const &s : strings)
+        {
+            max_size = std::max(max_size, s.size());
+        }
+        std::vector<uint8_t> compressed(z.compress_bound(max_size));
+        std::vector<char> decompressed(max_size);
+        std::size_t mismatches = 0;
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (auto const &s : strings)
+            {
+                const std::size_t n = z.compress(s, compressed.data(), compressed.size());
+                const std::size_t m = z.decompress(compressed.data(), n, decompressed.data(), decompressed.size());
+                if (m != s.size() || !std::equal(std::begin(s), std::end(s), std::begin(decompressed)))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        return mismatches;
+    }
+
+    /**
+     * Read the lines of `input` into `strings`.
+     */
+    bool read_lines(std::string const &input, std::vector<std::string> &strings)
+    {
+        std::ifstream in(input);
+        if (!in.is_open())
+        {
+            std::cerr << "\u001b[31;1mERROR: cannot open '" << input << "'.\u001b[0m\n";
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            strings.push_back(line);
+        }
+        return true;
+    }
+
+    /**
+     * Time compressing and decompressing all `strings` `repeat` times with `z`
+     * and print one line of results, starting with the compression ratio
+     * if `with_ratio` is set.
+     *
+     * @return whether all round trips succeeded
+     */
+    bool time_coder(char const *name, txtz::txtz const &z, std::vector<std::string> const &strings, std::size_t repeat, bool with_ratio = false)
+    {
+        std::size_t max_size = 0;
+        std::size_t total_size = 0;
+        for (auto const &s : strings)
+        {
+            max_size = std::max(max_size, s.size());
+            total_size += s.size();
+        }
+        const std::size_t bound = z.compress_bound(max_size);
+        std::vector<uint8_t> compressed(bound * strings.size());
+        std::vector<std::size_t> sizes(strings.size());
+        std::vector<char> decompressed(max_size);
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (std::size_t i = 0; i < strings.size(); ++i)
+            {
+                sizes[i] = z.compress(strings[i], compressed.data() + i * bound, bound);
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        std::size_t mismatches = 0;
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (std::size_t i = 0; i < strings.size(); ++i)
+            {
+                const std::size_t m = z.decompress(compressed.data() + i * bound, sizes[i], decompressed.data(), decompressed.size());
+                if (m != strings[i].size() || !std::equal(std::begin(strings[i]), std::end(strings[i]), std::begin(decompressed)))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        const double megabytes = 1e-6 * double(repeat * total_size);
+        std::cout << std::setw(14) << name;
+        if (with_ratio)
+        {
+            std::size_t compressed_size = 0;
+            for (auto size : sizes)
+            {
+                compressed_size += size;
+            }
+            std::cout << std::setw(10) << std::fixed << std::setprecision(1) << 1e2 * double(compressed_size) / double(total_size) << '%';
+        }
+        std::cout << std::setw(18) << std::fixed << std::setprecision(1) << megabytes / std::chrono::duration<double>(t1 - t0).count()
+                  << std::setw(20) << megabytes / std::chrono::duration<double>(t2 - t1).count() << '\n';
+        if (mismatches != 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: " << mismatches << " round trips failed.\u001b[0m\n";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Compare the generic coder, decoding bit by bit or with the
+     * multi-symbol table, with the one generated by `mapbuilder --specialize`,
+     * if it is built in.
+     */
+    bool benchmark_coders(std::string const &input, std::size_t repeat)
+    {
+        std::vector<std::string> strings;
+        if (!read_lines(input, strings))
+            return false;
+        std::cout << "Single-threaded round trips of " << strings.size() << " strings x " << repeat << "\n\n"
+                  << std::setw(14) << "coder"
+                  << std::setw(18) << "compress MB/s"
+                  << std::setw(20) << "decompress MB/s" << '\n';
+        const txtz::txtz generic(txtz::compression_table, txtz::compression_table_normalization);
+        const txtz::txtz bit_serial(std::make_shared<txtz::txtz::dictionary const>(
+            txtz::compression_table, generic.framing(), generic.normalization(), nullptr, txtz::txtz::decoder_t::bit_serial));
+        bool ok = time_coder("bit-serial", bit_serial, strings, repeat);
+        ok = time_coder("multi-symbol", generic, strings, repeat) && ok;
+        if (txtz::compression_table_specialization == nullptr)
+        {
+            std::cout << "\nNo specialized coder built in (see SPECIALIZE).\n";
+            return ok;
+        }
+        return time_coder("specialized", txtz::txtz(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization), strings, repeat) && ok;
+    }
+
+    /**
+     * Compare the tables built with Huffman's and with Shannon and Fano's
+     * algorithm on the lines of each of `inputs`: compression ratio, with
+     * every line compressed on its own, and throughput.
+     */
+    bool benchmark_algorithms(std::vector<std::string> const &inputs, std::size_t repeat)
+    {
+        bool ok = true;
+        for (auto const &input : inputs)
+        {
+            std::vector<std::string> strings;
+            if (!read_lines(input, strings))
+                return false;
+            std::cout << input << ": single-threaded round trips of " << strings.size() << " strings x " << repeat << "\n\n"
+                      << std::setw(14) << "algorithm"
+                      << std::setw(11) << "ratio"
+                      << std::setw(18) << "compress MB/s"
+                      << std::setw(20) << "decompress MB/s" << '\n';
+            for (char const *algo : {"huffman", "shannon-fano"})
+            {
+                auto const &table = txtz::compression_table_for(algo);
+                ok = time_coder(algo, txtz::txtz(table, txtz::compression_table_normalization, txtz::specialization_for(table)), strings, repeat, true) && ok;
+            }
+            std::cout << '\n';
+        }
+        return ok;
+    }
+
+    /**
+     * The bit reader as it was before refills loaded 8 bytes at once,
+     * checking for the end of the input before every byte.
+     */
+    class bytewise_bit_reader
+    {
+    public:
+        bytewise_bit_reader(uint8_t const *in, std::size_t size)
+            : it_(in), last_(in + size) {}
+
+        void refill()
+        {
+            while (available_ <= 56 && it_ != last_)
+            {
+                window_ |= uint64_t(*it_++) << (56 - available_);
+                available_ += 8;
+            }
+        }
+
+        uint64_t window() const
+        {
+            return window_;
+        }
+
+        unsigned int available() const
+        {
+            return available_;
+        }
+
+        void consume(unsigned int n)
+        {
+            window_ = n < 64 ? window_ << n : 0;
+            available_ -= n;
+        }
+
+    private:
+        uint8_t const *it_;
+        uint8_t const *last_;
+        uint64_t window_{0};
+        unsigned int available_{0};
+    };
+
+    /**
+     * Decode each of `records` `repeat` times with `table`, reading bits
+     * with `ReaderT`, and print the throughput in MB of compressed data
+     * per second.
+     */
+    template <typename ReaderT, typename TableT>
+    void time_refill(char const *name, TableT const &table, std::vector<std::vector<uint8_t>> const &records, std::size_t capacity, std::size_t repeat)
+    {
+        std::size_t total_size = 0;
+        for (auto const &record : records)
+        {
+            total_size += record.size();
+        }
+        std::vector<char> decompressed(capacity);
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (auto const &record : records)
+            {
+                table.template decompress<ReaderT>(record.data(), record.size(), decompressed.data(), decompressed.size());
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        std::cout << std::setw(14) << name
+                  << std::setw(18) << std::fixed << std::setprecision(1) << 1e-6 * double(repeat * total_size) / std::chrono::duration<double>(t1 - t0).count() << '\n';
+    }
+
+    /**
+     * Decode each of `records` `repeat` times with `z` and print the
+     * throughput in MB of compressed data per second, followed by how
+     * many records were rejected as corrupt or too long for `capacity`.
+     * Any other outcome, e.g. a crash or a hang, is a bug in the decoder.
+     */
+    void time_decoder(txtz::txtz const &z, std::vector<std::vector<uint8_t>> const &records, std::size_t capacity, std::size_t repeat)
+    {
+        std::size_t total_size = 0;
+        for (auto const &record : records)
+        {
+            total_size += record.size();
+        }
+        std::vector<char> decompressed(capacity);
+        std::size_t rejected = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (auto const &record : records)
+            {
+                try
+                {
+                    z.decompress(record.data(), record.size(), decompressed.data(), decompressed.size());
+                }
+                catch (std::out_of_range const &)
+                {
+                    ++rejected;
+                }
+                catch (std::length_error const &)
+                {
+                    ++rejected;
+                }
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        std::cout << std::setw(18) << std::fixed << std::setprecision(1) << 1e-6 * double(repeat * total_size) / std::chrono::duration<double>(t1 - t0).count()
+                  << std::setw(12) << rejected / repeat;
+    }
+
+    /**
+     * Feed every decoder the compressed lines of `input` as they are and
+     * mutated like a fuzzer would, i.e. truncated, with flipped bits and
+     * replaced by random bytes, and compare the decoding throughput.
+     * The decoders check the end of the input once per refill of their
+     * bit window, so garbage must neither be slower nor escape the output
+     * buffer. With stop token framing, the multi-symbol decoder is then
+     * timed on the intact records with both the per-word refill and the
+     * per-byte refill it replaced.
+     */
+    bool benchmark_corrupt(std::string const &input, std::size_t repeat)
+    {
+        std::vector<std::string> strings;
+        if (!read_lines(input, strings))
+            return false;
+        const txtz::txtz generic(txtz::compression_table, txtz::compression_table_normalization);
+        std::size_t max_size = 0;
+        for (auto const &s : strings)
+        {
+            max_size = std::max(max_size, s.size());
+        }
+        std::mt19937 rng(4711);
+        std::vector<std::vector<uint8_t>> intact;
+        std::vector<std::vector<uint8_t>> corrupt;
+        for (auto const &s : strings)
+        {
+            std::size_t bits;
+            intact.push_back(generic.compress(s, bits));
+            std::vector<uint8_t> record = intact.back();
+            if (record.empty())
+            {
+                corrupt.push_back(record);
+                continue;
+            }
+            switch (rng() % 3)
+            {
+            case 0:
+                record.resize(rng() % record.size());
+                break;
+            case 1:
+                for (std::size_t i = 0; i < 1 + record.size() / 4; ++i)
+                {
+                    record[rng() % record.size()] ^= static_cast<uint8_t>(1U << (rng() % 8));
+                }
+                break;
+            default:
+                for (auto &byte : record)
+                {
+                    byte = static_cast<uint8_t>(rng());
+                }
+                break;
+            }
+            corrupt.push_back(record);
+        }
+        std::cout << "Single-threaded decoding of " << strings.size() << " records x " << repeat << " into " << max_size << " bytes\n\n"
+                  << std::setw(14) << "decoder"
+                  << std::setw(18) << "intact MB/s"
+                  << std::setw(12) << "rejected"
+                  << std::setw(18) << "corrupt MB/s"
+                  << std::setw(12) << "rejected" << '\n';
+        const txtz::txtz bit_serial(std::make_shared<txtz::txtz::dictionary const>(
+            txtz::compression_table, generic.framing(), generic.normalization(), nullptr, txtz::txtz::decoder_t::bit_serial));
+        std::vector<std::pair<char const *, txtz::txtz>> decoders{{"bit-serial", bit_serial}, {"multi-symbol", generic}};
+        if (txtz::compression_table_specialization != nullptr)
+        {
+            decoders.emplace_back("specialized", txtz::txtz(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization));
+        }
+        for (auto const &[name, z] : decoders)
+        {
+            std::cout << std::setw(14) << name;
+            time_decoder(z, intact, max_size, repeat);
+            time_decoder(z, corrupt, max_size, repeat);
+            std::cout << '\n';
+        }
+        if (generic.framing() != txtz::txtz::framing_t::stop_token)
+            return true;
+        // the multi-symbol table once more, reading the intact records with either bit reader
+        bintree<txtz::code_t, uint32_t, uint8_t> tree{std::string(&txtz::txtz::STOP_TOKEN, 1)};
+        std::vector<decltype(tree)::entry> entries;
+        for (auto const &[token, c] : txtz::compression_table)
+        {
+            entries.push_back({c.bits(), static_cast<uint32_t>(c.bitcount()), token});
+        }
+        tree.build(std::move(entries));
+        if (tree.max_code_length() > multitable<decltype(tree)>::MAX_CODE_LENGTH)
+            return true;
+        multitable<decltype(tree)> table;
+        table.build(tree);
+        std::cout << "\nMulti-symbol decoding of the intact records\n\n"
+                  << std::setw(14) << "refill"
+                  << std::setw(18) << "MB/s" << '\n';
+        time_refill<bytewise_bit_reader>("per byte", table, intact, max_size, repeat);
+        time_refill<txtz::bit_reader>("per word", table, intact, max_size, repeat);
+        return true;
+    }
+
+    /**
+     * Round-trip every line of `strings` `repeat` times through `compress`
+     * and `decompress`, which work on the `capacity` bytes at `buffer`,
+     * and print the size of the output relative to the input and the
+     * throughput in MB of uncompressed data per second.
+     *
+     * @return whether all strings survived the round trip
+     */
+    template <typename CompressT, typename DecompressT>
+    bool time_round_trip(char const *name, std::vector<std::string> const &strings, std::size_t repeat,
+                         CompressT compress, DecompressT decompress)
+    {
+        std::size_t total_size = 0;
+        std::size_t max_size = 0;
+        for (auto const &s : strings)
+        {
+            total_size += s.size();
+            max_size = std::max(max_size, s.size());
+        }
+        std::vector<std::string> outputs(strings.size());
+        const auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (std::size_t i = 0; i < strings.size(); ++i)
+            {
+                compress(strings[i], outputs[i]);
+            }
+        }
+        const auto t1 = std::chrono::steady_clock::now();
+        std::size_t output_size = 0;
+        for (auto const &output : outputs)
+        {
+            output_size += output.size();
+        }
+        std::vector<char> decompressed(max_size);
+        bool ok = true;
+        for (std::size_t r = 0; r < repeat; ++r)
+        {
+            for (std::size_t i = 0; i < strings.size(); ++i)
+            {
+                const std::size_t length = decompress(outputs[i], decompressed.data(), decompressed.size());
+                ok = ok && std::string_view(decompressed.data(), length) == strings[i];
+            }
+        }
+        const auto t2 = std::chrono::steady_clock::now();
+        const double mb = 1e-6 * double(repeat * total_size);
+        std::cout << std::setw(14) << name
+                  << std::setw(10) << std::fixed << std::setprecision(1) << 100.0 * double(output_size) / double(total_size) << '%'
+                  << std::setw(18) << mb / std::chrono::duration<double>(t1 - t0).count()
+                  << std::setw(20) << mb / std::chrono::duration<double>(t2 - t1).count() << '\n';
+        if (!ok)
+        {
+            std::cerr << "\u001b[31;1mERROR: round trip through " << name << " failed.\u001b[0m\n";
+        }
+        return ok;
+    }
+
+    /**
+     * Compare compressing the lines of `input` to binary with compressing
+     * them straight to base64 and base85 text.
+     */
+    bool benchmark_text(std::string const &input, std::size_t repeat)
+    {
+        std::vector<std::string> strings;
+        if (!read_lines(input, strings))
+            return false;
+        const txtz::txtz z(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization);
+        std::cout << "Single-threaded round trips of " << strings.size() << " strings x " << repeat
+                  << ", base64 coded with " << txtz::text::instruction_set() << "\n\n"
+                  << std::setw(14) << "output"
+                  << std::setw(11) << "size"
+                  << std::setw(18) << "compress MB/s"
+                  << std::setw(20) << "decompress MB/s" << '\n';
+        std::vector<uint8_t> buffer;
+        bool ok = time_round_trip(
+            "binary", strings, repeat,
+            [&z, &buffer](std::string const &s, std::string &out)
+            {
+                buffer.resize(z.compress_bound(s.size()));
+                out.assign(reinterpret_cast<char const *>(buffer.data()), z.compress(s, buffer.data(), buffer.size()));
+            },
+            [&z](std::string const &in, char *out, std::size_t capacity)
+            { return z.decompress(reinterpret_cast<uint8_t const *>(in.data()), in.size(), out, capacity); });
+        for (auto encoding : {txtz::text::encoding_t::base64, txtz::text::encoding_t::base85})
+        {
+            const txtz::text::codec tc(z, encoding);
+            ok = time_round_trip(
+                     encoding == txtz::text::encoding_t::base64 ? "base64" : "base85", strings, repeat,
+                     [&tc](std::string const &s, std::string &out)
+                     {
+                         std::size_t bits;
+                         out.resize(tc.compress_bound(s.size()));
+                         out.resize(tc.compress(s, out.data(), out.size(), bits));
+                     },
+                     [&tc](std::string const &in, char *out, std::size_t capacity)
+                     { return tc.decompress(in.data(), in.size(), out, capacity); }) &&
+                 ok;
+        }
+        return ok;
+    }
+
+    /**
+     * Measure how round-trip throughput scales with the number of threads
+     * sharing one dictionary. The thread count doubles from 1 up to
+     * `max_threads`.
+     */
+    bool benchmark_scaling(std::string const &input, unsigned int max_threads, std::size_t repeat)
+    {
+        std::vector<std::string> strings;
+        if (!read_lines(input, strings))
+            return false;
+        const txtz::txtz z(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization);
+        std::cout << "Round trips of " << strings.size() << " strings x " << repeat
+                  << " per thread, one shared dictionary (" << z.shared_dictionary()->memory_usage() << " bytes)\n\n"
+                  << std::setw(8) << "threads"
+                  << std::setw(12) << "time/ms"
+                  << std::setw(16) << "Mstrings/s"
+                  << std::setw(10) << "speedup"
+                  << std::setw(12) << "efficiency" << '\n';
+        double single = 0;
+        bool ok = true;
+        for (unsigned int n = 1; n <= max_threads; n *= 2)
+        {
+            std::vector<std::thread> threads;
+            std::vector<std::size_t> mismatches(n);
+            const auto t0 = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                threads.emplace_back([&, i]()
+                                     { mismatches[i] = round_trip(z, strings, repeat); });
+            }
+            for (auto &t : threads)
+            {
+                t.join();
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+            const double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            const double rate = 1e-3 * double(n * repeat * strings.size()) / ms;
+            if (n == 1)
+            {
+                single = rate;
+            }
+            std::cout << std::setw(8) << n
+                      << std::setw(12) << std::fixed << std::setprecision(1) << ms
+                      << std::setw(16) << std::setprecision(3) << rate
+                      << std::setw(10) << std::setprecision(2) << rate / single
+                      << std::setw(11) << std::setprecision(0) << 1e2 * rate / single / n << "%\n";
+            for (auto m : mismatches)
+            {
+                if (m != 0)
+                {
+                    std::cerr << "\u001b[31;1mERROR: " << m << " round trips failed.\u001b[0m\n";
+                    ok = false;
+                }
+            }
+        }
+        return ok;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    using argparser = argparser::argparser;
+    argparser opt(argc, argv);
+    benchmark_t benchmark = INVALID_BENCHMARK;
+    std::string algo = "huffman";
+    std::size_t min_tokens = 10'000;
+    std::size_t max_tokens = 10'000'000;
+    double zipf_exponent = 1.0;
+    std::string input;
+    std::vector<std::string> inputs;
+    unsigned int max_threads = std::max(1U, std::thread::hardware_concurrency());
+    std::size_t repeat = 10;
+    opt
+        .info("txtz benchmark", argv[0])
+        .help({"-?", "--help"}, "Display this help")
+        .reg({"--codes"}, argparser::no_argument, "Benchmark code construction on synthetic Zipf-distributed vocabularies", [&benchmark](std::string const &)
+             { benchmark = CODES; })
+        .reg({"-a", "--algo"}, "ALGO", argparser::required_argument, "Code construction algorithm: huffman (default) or shannon-fano", [&algo](std::string const &arg)
+             { algo = arg; })
+        .reg({"--min-tokens"}, "N", argparser::required_argument, "Smallest vocabulary size (default: 10000)", [&min_tokens](std::string const &arg)
+             { min_tokens = std::stoul(arg); })
+        .reg({"--max-tokens"}, "N", argparser::required_argument, "Largest vocabulary size (default: 10000000)", [&max_tokens](std::string const &arg)
+             { max_tokens = std::stoul(arg); })
+        .reg({"--zipf-exponent"}, "S", argparser::required_argument, "Exponent of the Zipf distribution (default: 1.0)", [&zipf_exponent](std::string const &arg)
+             { zipf_exponent = std::stod(arg); })
+        .reg({"--scaling"}, argparser::no_argument, "Benchmark multithreaded round trips of the lines in INPUT sharing one dictionary", [&benchmark](std::string const &)
+             { benchmark = SCALING; })
+        .reg({"--coders"}, argparser::no_argument, "Compare the generic coder with the specialized one on the lines in INPUT", [&benchmark](std::string const &)
+             { benchmark = CODERS; })
+        .reg({"--algorithms"}, argparser::no_argument, "Compare the Huffman and Shannon-Fano tables on the lines of every INPUT", [&benchmark](std::string const &)
+             { benchmark = ALGORITHMS; })
+        .reg({"--corrupt"}, argparser::no_argument, "Compare decoding the compressed lines in INPUT intact and corrupted", [&benchmark](std::string const &)
+             { benchmark = CORRUPT; })
+        .reg({"--text"}, argparser::no_argument, "Compare compressing the lines in INPUT to binary, base64 and base85", [&benchmark](std::string const &)
+             { benchmark = TEXT; })
+        .reg({"-i", "--input"}, "INPUT", argparser::required_argument, "Input file for --scaling, --coders, --corrupt and --text; may be given several times for --algorithms", [&input, &inputs](std::string const &arg)
+             {
+                 input = arg;
+                 inputs.push_back(arg);
+             })
+        .reg({"-t", "--threads"}, "N", argparser::required_argument, "Maximum number of threads (default: number of hardware threads)", [&max_threads](std::string const &arg)
+             { max_threads = static_cast<unsigned int>(std::stoul(arg)); })
+        .reg({"--repeat"}, "N", argparser::required_argument, "Passes over INPUT per thread (default: 10)", [&repeat](std::string const &arg)
+             { repeat = std::stoul(arg); });
+    try
+    {
+        opt();
+    }
+    catch (::argparser::help_requested_exception const &)
+    {
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
+    if (algo != "huffman" && algo != "shannon-fano")
+    {
+        std::cerr << "\u001b[31;1mERROR: unknown algorithm '" << algo << "'.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (min_tokens == 0 || min_tokens > max_tokens)
+    {
+        std::cerr << "\u001b[31;1mERROR: invalid vocabulary size range.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
+    switch (benchmark)
+    {
+    case CODES:
+        benchmark_codes(algo, min_tokens, max_tokens, zipf_exponent);
+        break;
+    case SCALING:
+        if (input.empty())
+        {
+            std::cerr << "\u001b[31;1mERROR: --scaling requires an input file.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (max_threads == 0 || repeat == 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: --threads and --repeat must be positive.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (!benchmark_scaling(input, max_threads, repeat))
+            return EXIT_FAILURE;
+        break;
+    case CODERS:
+        if (input.empty())
+        {
+            std::cerr << "\u001b[31;1mERROR: --coders requires an input file.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (repeat == 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: --repeat must be positive.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (!benchmark_coders(input, repeat))
+            return EXIT_FAILURE;
+        break;
+    case ALGORITHMS:
+        if (inputs.empty() || repeat == 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: --algorithms requires input files and a positive --repeat.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (!benchmark_algorithms(inputs, repeat))
+            return EXIT_FAILURE;
+        break;
+    case CORRUPT:
+        if (input.empty() || repeat == 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: --corrupt requires an input file and a positive --repeat.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (!benchmark_corrupt(input, repeat))
+            return EXIT_FAILURE;
+        break;
+    case TEXT:
+        if (input.empty() || repeat == 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: --text requires an input file and a positive --repeat.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (!benchmark_text(input, repeat))
+            return EXIT_FAILURE;
+        break;
+    case INVALID_BENCHMARK:
+        std::cerr << "\u001b[31;1mERROR: no benchmark selected, see --help.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -28,166 +28,355 @@
 #ifndef __BINTREE_HPP__
 #define __BINTREE_HPP__
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "util.hpp"
 
-template <typename CodeT, typename LengthT, typename ValueT, typename StoreT>
+/**
+ * A binary decoding tree for prefix-free codes.
+ *
+ * All nodes live in a single contiguous array in breadth-first order.
+ * The two children of an internal node are stored next to each other,
+ * so a node only needs the index of its left child. Leaves refer to
+ * their token by offset and length into a shared blob of token bytes.
+ */
+template <typename CodeT, typename LengthT, typename StoreT>
 class bintree
 {
 public:
+    /**
+     * A code/token pair to build the tree from.
+     */
+    struct entry
+    {
+        CodeT code;
+        LengthT length;
+        std::string_view token;
+    };
+
     struct node
     {
-        node *left{nullptr};
-        node *right{nullptr};
-        ValueT value{};
+        static constexpr uint32_t LEAF = 0x80000000U;
+        /**
+         * Internal node: index of left child, the right child follows
+         * immediately; 0 if the node is a dead end (the root is never
+         * a child). Leaf: offset of the token in the blob.
+         */
+        uint32_t index;
+        /**
+         * Token length with `LEAF` set for leaves, 0 for internal nodes.
+         */
+        uint32_t length;
+
+        bool is_leaf() const
+        {
+            return (length & LEAF) != 0;
+        }
+        uint32_t token_length() const
+        {
+            return length & ~LEAF;
+        }
     };
 
-    bintree(ValueT stop_value) : stop_value_(stop_value) {}
+    explicit bintree(std::string stop_value) : stop_value_(std::move(stop_value)) {}
 
-    ~bintree()
+    /**
+     * Build the tree from all `entries` in a single breadth-first pass.
+     *
+     * The entries are sorted by their left-aligned code, so that every
+     * subtree covers a contiguous range of entries. Because nodes are
+     * appended in the order they are visited, the range belonging to
+     * node i can be kept at position i of a parallel array instead of
+     * a separate queue.
+     *
+     * @throw std::invalid_argument if there are no entries or the codes aren't prefix-free
+     */
+    void build(std::vector<entry> entries)
     {
-        clear(root_);
+        constexpr unsigned int CODE_BITS = 8 * sizeof(CodeT);
+        if (entries.empty())
+            throw std::invalid_argument("cannot build tree without entries");
+        for (auto &e : entries)
+        {
+            if (e.length == 0 || e.length > CODE_BITS)
+                throw std::invalid_argument("invalid code length");
+            e.code <<= (CODE_BITS - e.length);
+        }
+        std::sort(std::begin(entries), std::end(entries), [](entry const &a, entry const &b)
+                  { return a.code < b.code || (a.code == b.code && a.length < b.length); });
+
+        struct range
+        {
+            std::size_t first;
+            std::size_t last;
+            LengthT depth;
+        };
+        std::size_t blob_size = 0;
+        for (auto const &e : entries)
+        {
+            blob_size += e.token.size();
+        }
+        nodes_.clear();
+        nodes_.reserve(2 * entries.size());
+        blob_.clear();
+        blob_.reserve(blob_size);
+        stop_node_ = 0;
+        max_code_length_ = 0;
+        std::vector<range> ranges;
+        ranges.reserve(2 * entries.size());
+        nodes_.push_back(node{0, 0});
+        ranges.push_back(range{0, entries.size(), 0});
+        for (std::size_t i = 0; i < nodes_.size(); ++i)
+        {
+            const range r = ranges[i];
+            if (r.first == r.last)
+                continue; // dead end
+            entry const &e = entries[r.first];
+            if (e.length == r.depth)
+            {
+                if (r.last - r.first != 1)
+                    throw std::invalid_argument("code is not prefix-free");
+                nodes_[i] = node{static_cast<uint32_t>(blob_.size()), static_cast<uint32_t>(e.token.size()) | node::LEAF};
+                blob_.append(e.token);
+                max_code_length_ = std::max(max_code_length_, e.length);
+                if (e.token == stop_value_)
+                {
+                    stop_node_ = static_cast<uint32_t>(i);
+                }
+                continue;
+            }
+            const CodeT mask = CodeT(1) << (CODE_BITS - 1 - r.depth);
+            auto split = std::partition_point(std::begin(entries) + static_cast<std::ptrdiff_t>(r.first),
+                                              std::begin(entries) + static_cast<std::ptrdiff_t>(r.last),
+                                              [mask](entry const &x)
+                                              { return (x.code & mask) == 0; });
+            const std::size_t mid = static_cast<std::size_t>(split - std::begin(entries));
+            if (nodes_.size() + 2 > std::numeric_limits<uint32_t>::max())
+                throw std::length_error("too many nodes");
+            nodes_[i].index = static_cast<uint32_t>(nodes_.size());
+            nodes_.push_back(node{0, 0});
+            nodes_.push_back(node{0, 0});
+            ranges.push_back(range{r.first, mid, static_cast<LengthT>(r.depth + 1)});
+            ranges.push_back(range{mid, r.last, static_cast<LengthT>(r.depth + 1)});
+        }
+        nodes_.shrink_to_fit();
     }
 
-    std::string decompress(std::vector<StoreT> const &compressed)
+    /**
+     * Decode `compressed` up to the stop value.
+     *
+     * @throw std::out_of_range if the bit stream contains an invalid code or ends before the stop value
+     */
+    std::string decompress(std::vector<StoreT> const &compressed) const
     {
         auto it = std::begin(compressed);
-        std::ostringstream oss;
-        node *n = root_;
-        int bit_idx = 0;
-        StoreT byte = *it;
-        for (;;)
+        const auto last = std::end(compressed);
+        std::string result;
+        uint32_t n = 0;
+        while (it != last)
         {
-            if ((byte & 0b10000000) == 0)
+            StoreT byte = *it++;
+            for (int bit_idx = 0; bit_idx < 8; ++bit_idx)
             {
-                if (n->left)
+                n = nodes_[n].index + ((byte & 0b10000000) != 0);
+                if (nodes_[n].is_leaf())
                 {
-                    n = n->left;
+                    if (n == stop_node_)
+                        return result;
+                    result.append(blob_, nodes_[n].index, nodes_[n].token_length());
+                    n = 0;
                 }
-            }
-            else
-            {
-                if (n->right)
+                else if (nodes_[n].index == 0)
                 {
-                    n = n->right;
+                    throw std::out_of_range("invalid code in compressed data");
                 }
-            }
-            if (!n->left && !n->right)
-            {
-                if (n->value == stop_value_)
-                    break;
-                oss << n->value;
-                n = root_;
-            }
-            if (++bit_idx == 8)
-            {
-                bit_idx = 0;
-                byte = *(++it);
-            }
-            else
-            {
                 byte <<= 1;
             }
         }
-        return oss.str();
+        throw std::out_of_range("compressed data truncated");
     }
 
     /**
-     * @param code
+     * Decode the `size` bytes at `in` into the `capacity` bytes at `out`
+     * up to the stop value.
+     *
+     * @return number of bytes written to `out`
+     * @throw std::length_error if the output doesn't fit into `out`
+     * @throw std::out_of_range if the bit stream contains an invalid code or ends before the stop value
      */
-    void append(CodeT code, LengthT length, ValueT const &token)
+    std::size_t decompress(StoreT const *in, std::size_t size, char *out, std::size_t capacity) const
     {
-        constexpr CodeT mask = (1ULL << (8 * sizeof(CodeT) - 1));
-        code <<= (8 * sizeof(CodeT) - length);
-        node *n = root_;
-        while (length-- > 0)
+        std::size_t pos = 0;
+        uint32_t n = 0;
+        for (StoreT const *const last = in + size; in != last; ++in)
         {
-            if ((code & mask) == 0)
+            StoreT byte = *in;
+            for (int bit_idx = 0; bit_idx < 8; ++bit_idx)
             {
-                if (!n->left)
+                n = nodes_[n].index + ((byte & 0b10000000) != 0);
+                node const &leaf = nodes_[n];
+                if (leaf.is_leaf())
                 {
-                    n->left = new node();
+                    if (n == stop_node_)
+                        return pos;
+                    if (leaf.token_length() > capacity - pos)
+                        throw std::length_error("output buffer too small");
+                    std::copy_n(blob_.data() + leaf.index, leaf.token_length(), out + pos);
+                    pos += leaf.token_length();
+                    n = 0;
                 }
-                n = n->left;
-            }
-            else
-            {
-                if (!n->right)
+                else if (leaf.index == 0)
                 {
-                    n->right = new node();
+                    throw std::out_of_range("invalid code in compressed data");
                 }
-                n = n->right;
+                byte <<= 1;
             }
-            code <<= 1;
         }
-        n->value = token;
+        throw std::out_of_range("compressed data truncated");
     }
 
-    static bool find(ValueT const &token, const node *const root)
+    /**
+     * Decode exactly `length` bytes of output from the `size` bytes at `in`.
+     * No stop value is expected, so the loop only has to watch the output
+     * position.
+     *
+     * @throw std::out_of_range if the bit stream ends before `length` bytes were decoded
+     */
+    void decompress_exactly(StoreT const *in, std::size_t size, char *out, std::size_t length) const
     {
-        if (root->left == nullptr && root->right == nullptr)
-        {
-            return root->value == token;
-        }
-        if (find(token, root->left))
+        std::size_t pos = 0;
+        StoreT const *const last = in + size;
+        uint32_t n = 0;
+        while (pos < length)
         {
-            return true;
+            if (in == last)
+                throw std::out_of_range("compressed data truncated");
+            StoreT byte = *in++;
+            for (int bit_idx = 0; bit_idx < 8; ++bit_idx)
+            {
+                n = nodes_[n].index + ((byte & 0b10000000) != 0);
+                node const &leaf = nodes_[n];
+                if (leaf.is_leaf())
+                {
+                    if (leaf.token_length() > length - pos)
+                        throw std::out_of_range("compressed data exceeds announced length");
+                    std::copy_n(blob_.data() + leaf.index, leaf.token_length(), out + pos);
+                    pos += leaf.token_length();
+                    if (pos == length)
+                        break;
+                    n = 0;
+                }
+                else if (leaf.index == 0)
+                {
+                    throw std::out_of_range("invalid code in compressed data");
+                }
+                byte <<= 1;
+            }
         }
-        if (find(token, root->right))
+    }
+
+    /**
+     * Follow the code at the start of `window` (first bit in the MSB), of
+     * which `available` bits are valid, from the root to its leaf.
+     *
+     * @param bits receives the length of the code
+     * @return index of the leaf, 0 if the code is longer than `available` bits
+     * @throw std::out_of_range if the bits don't start with a valid code
+     */
+    uint32_t walk(uint64_t window, unsigned int available, unsigned int &bits) const
+    {
+        uint32_t n = 0;
+        for (bits = 0; bits < available;)
         {
-            return true;
+            n = nodes_[n].index + static_cast<uint32_t>(window >> 63);
+            window <<= 1;
+            ++bits;
+            if (nodes_[n].is_leaf())
+                return n;
+            if (nodes_[n].index == 0)
+                throw std::out_of_range("invalid code in compressed data");
         }
-        return false;
+        return 0;
     }
 
-    bool has(ValueT const &token) const
+    /**
+     * @return token of the leaf `n`
+     */
+    std::string_view token(uint32_t n) const
     {
-        return find(token, root_);
+        return std::string_view(blob_).substr(nodes_[n].index, nodes_[n].token_length());
     }
 
-    static void print(node *root, std::ostream &out)
+    /**
+     * @return whether leaf `n` holds the stop value
+     */
+    bool is_stop(uint32_t n) const
     {
-        if (root->left == nullptr && root->right == nullptr)
-        {
-            out << ' ' << util::escaped(root->value) << '\n';
-        }
-        if (root->left)
-        {
-            out << '0';
-            print(root->left, out);
-        }
-        if (root->right)
+        return n == stop_node_;
+    }
+
+    LengthT max_code_length() const
+    {
+        return max_code_length_;
+    }
+
+    bool has(std::string_view token) const
+    {
+        for (auto const &n : nodes_)
         {
-            out << '1';
-            print(root->right, out);
+            if (n.is_leaf() && std::string_view(blob_).substr(n.index, n.token_length()) == token)
+                return true;
         }
+        return false;
     }
 
     std::string print() const
     {
         std::ostringstream oss;
-        print(root_, oss);
+        print(0, std::string(), oss);
         return oss.str();
     }
 
+    /**
+     * @return number of bytes occupied by nodes and token blob
+     */
+    std::size_t memory_usage() const
+    {
+        return nodes_.capacity() * sizeof(node) + blob_.capacity();
+    }
+
 private:
-    node *root_{new node};
-    ValueT stop_value_;
+    std::vector<node> nodes_;
+    std::string blob_;
+    std::string stop_value_;
+    /**
+     * Index of the leaf holding the stop value, 0 if there is none.
+     */
+    uint32_t stop_node_{0};
+    LengthT max_code_length_{0};
 
-    static void clear(node *root)
+    void print(uint32_t n, std::string const &prefix, std::ostream &out) const
     {
-        if (root == nullptr)
+        if (nodes_.empty())
             return;
-        if (root->left == nullptr && root->right == nullptr)
+        if (nodes_[n].is_leaf())
         {
-            delete root;
+            out << prefix << ' ' << util::escaped(blob_.substr(nodes_[n].index, nodes_[n].token_length())) << '\n';
             return;
         }
-        clear(root->left);
-        clear(root->right);
+        if (nodes_[n].index == 0)
+            return;
+        print(nodes_[n].index, prefix + '0', out);
+        print(nodes_[n].index + 1, prefix + '1', out);
     }
 };
 
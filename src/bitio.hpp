@@ -0,0 +1,175 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __BITIO_HPP__
+#define __BITIO_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace txtz
+{
+
+    /**
+     * Appends codes MSB first to a byte buffer of fixed capacity,
+     * collecting pending bits in a 64 bit accumulator.
+     */
+    class bit_writer
+    {
+    public:
+        bit_writer(uint8_t *out, std::size_t capacity)
+            : out_(out), capacity_(capacity) {}
+
+        void put(uint64_t bits, unsigned long length)
+        {
+            while (length > 32)
+            {
+                length -= 32;
+                put32(bits >> length, 32);
+            }
+            put32(bits, length);
+        }
+
+        /**
+         * Pad the last byte with zeros.
+         *
+         * @return number of bytes written
+         */
+        std::size_t finish()
+        {
+            if (pending_ > 0)
+            {
+                emit(static_cast<uint8_t>(acc_ << (8 - pending_)));
+                pending_ = 0;
+            }
+            return pos_;
+        }
+
+    private:
+        uint8_t *out_;
+        std::size_t capacity_;
+        std::size_t pos_{0};
+        uint64_t acc_{0};
+        unsigned long pending_{0};
+
+        void put32(uint64_t bits, unsigned long length)
+        {
+            acc_ = (acc_ << length) | (bits & ((uint64_t(1) << length) - 1));
+            pending_ += length;
+            while (pending_ >= 8)
+            {
+                pending_ -= 8;
+                emit(static_cast<uint8_t>(acc_ >> pending_));
+            }
+        }
+
+        void emit(uint8_t byte)
+        {
+            if (pos_ == capacity_)
+                throw std::length_error("output buffer too small");
+            out_[pos_++] = byte;
+        }
+    };
+
+    /**
+     * Reads a byte buffer MSB first through a 64 bit window, so that a
+     * decoder can look at the next bits of the stream all at once.
+     */
+    class bit_reader
+    {
+    public:
+        bit_reader(uint8_t const *in, std::size_t size)
+            : it_(in), last_(in + size) {}
+
+        /**
+         * Fill the window up to at least 57 bits, or as far as the input goes.
+         *
+         * While 8 bytes are left, they are read with a single load and
+         * as many of them as fit are shifted into the window, so there is
+         * one end-of-buffer check per refill, not per byte. Only the last
+         * 7 bytes of the input are read one at a time.
+         */
+        void refill()
+        {
+            if (available_ > 56)
+                return;
+            if (last_ - it_ >= 8)
+            {
+                uint64_t word = 0;
+                for (int i = 0; i < 8; ++i)
+                {
+                    word = (word << 8) | it_[i]; // compiles to a load and a byte swap
+                }
+                const unsigned int bytes = (64 - available_) >> 3;
+                window_ |= (word >> (64 - 8 * bytes)) << (64 - 8 * bytes - available_);
+                it_ += bytes;
+                available_ += 8 * bytes;
+                return;
+            }
+            while (available_ <= 56 && it_ != last_)
+            {
+                window_ |= uint64_t(*it_++) << (56 - available_);
+                available_ += 8;
+            }
+        }
+
+        /**
+         * @return the next 64 bits of the stream, first bit in the MSB; bits beyond `available()` are zero
+         */
+        uint64_t window() const
+        {
+            return window_;
+        }
+
+        /**
+         * @return number of valid bits in the window
+         */
+        unsigned int available() const
+        {
+            return available_;
+        }
+
+        /**
+         * Drop `n` bits from the window, where `n` must not exceed `available()`.
+         */
+        void consume(unsigned int n)
+        {
+            window_ = n < 64 ? window_ << n : 0;
+            available_ -= n;
+        }
+
+    private:
+        uint8_t const *it_;
+        uint8_t const *last_;
+        uint64_t window_{0};
+        unsigned int available_{0};
+    };
+
+}
+
+#endif // __BITIO_HPP__
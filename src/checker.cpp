@@ -26,31 +26,77 @@
 */
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
-#include <iterator>
+#include <iomanip>
+#include <iostream>
 #include <memory>
-#include <regex>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "frontcode.hpp"
 #include "getopt.hpp"
+#include "histogram.hpp"
 #include "mappings.hpp"
-#include "code.hpp"
+#include "pipeline.hpp"
+#include "record.hpp"
 #include "txtz.hpp"
-#include "shannon-fano.hpp"
+#include "util.hpp"
 
 namespace fs = std::filesystem;
 
 namespace
 {
-    typedef enum
+    using clock_type = std::chrono::steady_clock;
+
+    constexpr std::size_t BLOCK_SIZE = 256U * 1024U;
+    constexpr std::size_t MAX_LINE_SIZE = 1U << 28;
+
+    /**
+     * Figures collected by one worker thread. Aligned to keep workers
+     * from sharing cache lines.
+     */
+    struct alignas(64) worker_stats
+    {
+        std::size_t strings{0};
+        std::size_t mismatches{0};
+        std::size_t bytes_uncompressed{0};
+        std::size_t bytes_compressed{0};
+        double weighted_rates{0};
+        double weights{0};
+        clock_type::duration compress_time{};
+        clock_type::duration decompress_time{};
+        txtz::latency_histogram compress_latency;
+        txtz::latency_histogram decompress_latency;
+        /**
+         * Scratch buffers, reused for every string.
+         */
+        std::vector<uint8_t> compressed;
+        std::vector<char> decompressed;
+    };
+
+    double mb_per_s(std::size_t bytes, clock_type::duration d)
     {
-        INVALID_OP,
-        COMPRESS,
-        DECOMPRESS,
-    } opmode_t;
+        const double s = std::chrono::duration<double>(d).count();
+        return s > 0 ? 1e-6 * double(bytes) / s : 0.0;
+    }
+
+    void print_percentiles(std::string const &name, txtz::latency_histogram const &h)
+    {
+        auto ns = [&h](double q)
+        {
+            return h.percentile(q).count();
+        };
+        std::cout << name << " latency per string (ns): p50 < " << ns(0.5)
+                  << ", p90 < " << ns(0.9)
+                  << ", p99 < " << ns(0.99)
+                  << ", p99.9 < " << ns(0.999)
+                  << ", max < " << ns(1.0) << '\n';
+    }
 }
 
 auto is_deleter = [](std::istream *ptr) -> void
@@ -68,11 +114,26 @@ int main(int argc, char *argv[])
     argparser opt(argc, argv);
     char histo_delim = ';';
     char phoneme_delim = '|';
+    bool verbose = false;
+    bool records = false;
+    bool front_coding = false;
+    std::string algo = txtz::compression_table_algorithm;
+    unsigned int num_workers = std::max(1U, std::thread::hardware_concurrency());
     std::string input_filename;
     std::unique_ptr<std::istream, decltype(is_deleter)> in{nullptr, is_deleter};
     opt
         .info("txtz", argv[0])
         .help({"-?", "--help"}, "Display this help")
+        .reg({"-j", "--jobs"}, "N", argparser::required_argument, "Number of worker threads (default: number of cores)", [&num_workers](std::string const &arg)
+             { num_workers = static_cast<unsigned int>(std::max(1UL, std::stoul(arg))); })
+        .reg({"-r", "--records"}, argparser::no_argument, "Check comma separated records with one dictionary per field", [&records](std::string const &)
+             { records = true; })
+        .reg({"--front-coding"}, argparser::no_argument, "Check front coded lists of the sorted strings of each block, and look up every string", [&front_coding](std::string const &)
+             { front_coding = true; })
+        .reg({"-a", "--algo"}, "ALGO", argparser::required_argument, std::string("Check the codes built with this algorithm, huffman or shannon-fano (default: ") + txtz::compression_table_algorithm + ")", [&algo](std::string const &arg)
+             { algo = arg; })
+        .reg({"-v", "--verbose"}, argparser::no_argument, "Print every string with its compression rate", [&verbose](std::string const &)
+             { verbose = true; })
         .pos("INPUT_FILENAME", "input file", [&input_filename](std::string const &arg)
              { input_filename = arg; });
     try
@@ -108,42 +169,292 @@ int main(int argc, char *argv[])
         in.reset(new std::ifstream(input_filename, std::ios::binary));
     }
 
-    float sum_compression_rates = 0;
-    std::size_t rate_count = 0;
-    txtz::txtz z(txtz::compression_table);
-    std::string line;
-    while (std::getline(*in, line))
+    if (records && txtz::record_tables.empty())
+    {
+        std::cerr << "\u001b[31;1mERROR: no record dictionaries built in (see RECORD_FIELDS).\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (records && front_coding)
+    {
+        std::cerr << "\u001b[31;1mERROR: --records and --front-coding can't be combined.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (records && algo != txtz::compression_table_algorithm)
+    {
+        std::cerr << "\u001b[31;1mERROR: record dictionaries are only built with " << txtz::compression_table_algorithm << ".\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    std::unordered_map<std::string, txtz::code> const *table;
+    try
+    {
+        table = &txtz::compression_table_for(algo);
+    }
+    catch (std::invalid_argument const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << ".\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    const txtz::txtz z(*table, txtz::compression_table_normalization, txtz::specialization_for(*table));
+    const txtz::front_codec fc(z);
+    std::unique_ptr<txtz::record_codec> rc;
+    if (records)
+    {
+        rc = std::make_unique<txtz::record_codec>(txtz::record_tables, ',', txtz::compression_table_normalization);
+    }
+    auto compress = [&z, &rc](std::string const &s, worker_stats &st, std::size_t &bits)
+    {
+        return rc ? rc->compress(s, st.compressed.data(), st.compressed.size(), bits)
+                  : z.compress(s, st.compressed.data(), st.compressed.size(), bits);
+    };
+    auto decompress = [&z, &rc](std::size_t compressed_size, worker_stats &st)
+    {
+        return rc ? rc->decompress(st.compressed.data(), compressed_size, st.decompressed.data(), st.decompressed.size())
+                  : z.decompress(st.compressed.data(), compressed_size, st.decompressed.data(), st.decompressed.size());
+    };
+    const std::size_t max_token_length = rc ? rc->max_token_length() : z.max_token_length();
+    std::vector<worker_stats> stats(num_workers);
+
+    // split a line of the word list into the string and its weight
+    auto parse = [histo_delim, phoneme_delim](std::string const &line, std::string &s, double &weight) -> bool
     {
         auto word_histo = util::unpair(line, histo_delim);
         // remove phoneme delimiters
-        word_histo.first.erase(std::remove_if(std::begin(word_histo.first), std::end(word_histo.first), [&phoneme_delim](char c)
-                                              { return c == phoneme_delim; }),
+        word_histo.first.erase(std::remove(std::begin(word_histo.first), std::end(word_histo.first), phoneme_delim),
                                std::end(word_histo.first));
-        const auto weight = std::stoull(word_histo.second);
         // remove all CR/LF
-        std::string s;
+        s.clear();
         std::copy_if(std::begin(word_histo.first), std::end(word_histo.first), std::back_inserter(s), [](char c)
                      { return c != '\r' && c != '\n'; });
-        std::cout << s << " (" << weight << ") ";
-        std::size_t sz;
-        std::vector<uint8_t> out_buf;
-        out_buf = z.compress(s, sz);
-        sum_compression_rates += float(out_buf.size()) / (float(s.size())) * float(weight);
-        rate_count += weight;
-        const std::string &out_word = z.decompress(out_buf);
-        if (out_word == word_histo.first)
+        if (s.empty())
+            return false;
+        weight = 1;
+        if (!word_histo.second.empty())
+        {
+            try
+            {
+                weight = std::stod(word_histo.second);
+            }
+            catch (std::exception const &)
+            {
+            }
+        }
+        return true;
+    };
+
+    // The strings of a block are sorted and front coded as one list, which
+    // must decompress to the same strings; then every string is looked up
+    // by binary search. Lookup latencies are recorded as decompress latencies.
+    auto check_front_coded_block = [&](unsigned int worker, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+    {
+        worker_stats &st = stats[worker];
+        std::ostringstream report;
+        std::istringstream lines(std::string(std::begin(in_block), std::end(in_block)));
+        std::vector<std::string> strings;
+        double weights = 0;
+        std::size_t size = 0;
+        std::string line;
+        std::string s;
+        double weight;
+        while (std::getline(lines, line))
         {
-            std::cout << "\t\u001b[32;1mOK\u001b[0m "
-                      << std::setprecision(3) << 100 * float(out_buf.size()) / (float(s.size()))
-                      << "%\n";
+            if (!parse(line, s, weight))
+                continue;
+            strings.push_back(s);
+            weights += weight;
+            size += s.size();
         }
-        else
+        out_block.clear();
+        if (strings.empty())
+            return;
+        std::sort(std::begin(strings), std::end(strings));
+        const std::vector<std::string_view> views(std::begin(strings), std::end(strings));
+        st.strings += strings.size();
+        try
         {
-            std::cout << "\u001b[31;1mERROR\u001b[0m\n";
-            return EXIT_FAILURE;
+            std::size_t bits;
+            const auto t0 = clock_type::now();
+            const std::vector<uint8_t> list = fc.compress(views, bits);
+            const auto t1 = clock_type::now();
+            const std::vector<std::string> decompressed = fc.decompress(list.data(), list.size());
+            const auto t2 = clock_type::now();
+            st.compress_time += t1 - t0;
+            st.decompress_time += t2 - t1;
+            if (decompressed != strings)
+            {
+                report << "\u001b[31;1mERROR\u001b[0m front coded list of " << strings.size() << " strings doesn't decompress to its strings\n";
+                st.mismatches += strings.size();
+            }
+            else
+            {
+                const double rate = double(list.size()) / double(size);
+                st.bytes_uncompressed += size;
+                st.bytes_compressed += list.size();
+                st.weighted_rates += rate * weights;
+                st.weights += weights;
+            }
+            for (std::size_t i = 0; i < strings.size(); ++i)
+            {
+                std::size_t index;
+                const auto t3 = clock_type::now();
+                const bool found = fc.find(list.data(), list.size(), strings[i], index);
+                st.decompress_latency.record(clock_type::now() - t3);
+                // with duplicates, the first one is found
+                if (!found || index > i || strings[index] != strings[i] || fc.at(list.data(), list.size(), index) != strings[i])
+                {
+                    ++st.mismatches;
+                    report << strings[i] << "\t\u001b[31;1mERROR\u001b[0m not found\n";
+                }
+                else if (verbose)
+                {
+                    report << strings[i] << "\t\u001b[32;1mOK\u001b[0m\n";
+                }
+            }
+        }
+        catch (std::exception const &e)
+        {
+            st.mismatches += strings.size();
+            report << "\u001b[31;1mERROR\u001b[0m " << e.what() << '\n';
+        }
+        const std::string &text = report.str();
+        out_block.assign(std::begin(text), std::end(text));
+    };
+
+    // Every worker validates whole blocks of lines and reports mismatches
+    // (and, if verbose, every string) as text, which is printed in input order.
+    auto check_block = [&](unsigned int worker, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+    {
+        worker_stats &st = stats[worker];
+        std::ostringstream report;
+        std::istringstream lines(std::string(std::begin(in_block), std::end(in_block)));
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            std::string s;
+            double weight;
+            if (!parse(line, s, weight))
+                continue;
+            ++st.strings;
+            std::string error;
+            std::size_t compressed_size = 0;
+            std::size_t decompressed_size = 0;
+            try
+            {
+                st.compressed.resize(rc ? rc->compress_bound(s.size()) : z.compress_bound(s.size()));
+                st.decompressed.resize(s.size() + max_token_length);
+                std::size_t bits;
+                const auto t0 = clock_type::now();
+                compressed_size = compress(s, st, bits);
+                const auto t1 = clock_type::now();
+                decompressed_size = decompress(compressed_size, st);
+                const auto t2 = clock_type::now();
+                st.compress_time += t1 - t0;
+                st.decompress_time += t2 - t1;
+                st.compress_latency.record(t1 - t0);
+                st.decompress_latency.record(t2 - t1);
+                // the size estimate must match what compress() reports
+                const std::size_t estimated_bits = rc ? rc->compressed_bits(s) : z.compressed_bits(s);
+                if (estimated_bits != bits)
+                {
+                    error = "estimated " + std::to_string(estimated_bits) + " bits, but compressed to " + std::to_string(bits) + " bits";
+                }
+            }
+            catch (std::exception const &e)
+            {
+                error = e.what();
+            }
+            const bool ok = error.empty() && std::string_view(st.decompressed.data(), decompressed_size) == s;
+            if (ok)
+            {
+                const double rate = double(compressed_size) / double(s.size());
+                st.bytes_uncompressed += s.size();
+                st.bytes_compressed += compressed_size;
+                st.weighted_rates += rate * weight;
+                st.weights += weight;
+                if (verbose)
+                {
+                    report << s << " (" << weight << ")\t\u001b[32;1mOK\u001b[0m "
+                           << std::setprecision(3) << 100 * rate << "%\n";
+                }
+            }
+            else
+            {
+                ++st.mismatches;
+                report << s << " (" << weight << ")\t\u001b[31;1mERROR\u001b[0m ";
+                if (error.empty())
+                {
+                    report << "decompressed to \"" << util::escaped(std::string(st.decompressed.data(), decompressed_size)) << "\"\n";
+                }
+                else
+                {
+                    report << error << '\n';
+                }
+            }
         }
+        const std::string &text = report.str();
+        out_block.assign(std::begin(text), std::end(text));
+    };
+
+    const auto t0 = clock_type::now();
+    try
+    {
+        txtz::pipeline(num_workers, 4 * std::size_t(num_workers))
+            .run(txtz::pipeline::line_reader(*in, BLOCK_SIZE, MAX_LINE_SIZE), front_coding ? txtz::pipeline::worker(check_front_coded_block) : txtz::pipeline::worker(check_block), [](txtz::pipeline::block const &b)
+                 { std::cout.write(b.data(), static_cast<std::streamsize>(b.size())); });
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    const auto wall_time = clock_type::now() - t0;
+
+    worker_stats total;
+    // the workers run side by side, so each phase lasted as long as it kept the busiest of them
+    clock_type::duration compress_span{};
+    clock_type::duration decompress_span{};
+    for (auto const &st : stats)
+    {
+        compress_span = std::max(compress_span, st.compress_time);
+        decompress_span = std::max(decompress_span, st.decompress_time);
+        total.strings += st.strings;
+        total.mismatches += st.mismatches;
+        total.bytes_uncompressed += st.bytes_uncompressed;
+        total.bytes_compressed += st.bytes_compressed;
+        total.weighted_rates += st.weighted_rates;
+        total.weights += st.weights;
+        total.compress_time += st.compress_time;
+        total.decompress_time += st.decompress_time;
+        total.compress_latency.merge(st.compress_latency);
+        total.decompress_latency.merge(st.decompress_latency);
+    }
+
+    std::cout << '\n'
+              << total.strings << " strings checked with " << num_workers << " threads in "
+              << std::fixed << std::setprecision(2) << std::chrono::duration<double>(wall_time).count() << " s, "
+              << total.mismatches << " mismatches\n";
+    if (front_coding)
+    {
+        print_percentiles("lookup    ", total.decompress_latency);
+    }
+    else
+    {
+        print_percentiles("compress  ", total.compress_latency);
+        print_percentiles("decompress", total.decompress_latency);
+    }
+    std::cout << "compress:   " << std::setprecision(1) << mb_per_s(total.bytes_uncompressed, total.compress_time) << " MB/s per thread, "
+              << mb_per_s(total.bytes_uncompressed, compress_span) << " MB/s across " << num_workers << " threads\n"
+              << "decompress: " << mb_per_s(total.bytes_uncompressed, total.decompress_time) << " MB/s per thread, "
+              << mb_per_s(total.bytes_uncompressed, decompress_span) << " MB/s across " << num_workers << " threads\n"
+              << "round trip: " << mb_per_s(total.bytes_uncompressed, wall_time) << " MB/s total\n";
+    if (total.weights > 0)
+    {
+        std::cout << "avg. compression rate: " << std::setprecision(3) << 1e2 * total.weighted_rates / total.weights << "%\n";
+    }
+    if (total.mismatches > 0)
+    {
+        std::cout << "\u001b[31;1mFAILED!\u001b[0m\n";
+        return EXIT_FAILURE;
     }
     std::cout << "\nSUCCESS!\n";
-    std::cout << "avg. compression rate: " << 1e2f * sum_compression_rates / float(rate_count) << "%\n";
     return EXIT_SUCCESS;
 }
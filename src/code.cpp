@@ -68,6 +68,18 @@ namespace txtz
         return x;
     }
 
+    code code::reversed(void) const
+    {
+        code_t bits = 0;
+        code_t b = bits_;
+        for (unsigned long i = 0; i < bitcount_; ++i)
+        {
+            bits = (bits << 1) | (b & 1);
+            b >>= 1;
+        }
+        return code(bitcount_, bits);
+    }
+
     std::string code::str(void) const
     {
         std::ostringstream oss;
@@ -25,6 +25,10 @@ namespace txtz
         code_t bits(void) const;
         void append(bool bit);
         std::string str(void) const;
+        /**
+         * @return the same code with its bits in opposite order
+         */
+        code reversed(void) const;
 
         friend std::ostream &operator<<(std::ostream &os, code const &c)
         {
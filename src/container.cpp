@@ -0,0 +1,182 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "container.hpp"
+
+namespace txtz
+{
+    namespace container
+    {
+        namespace
+        {
+            void append_uint64(std::vector<uint8_t> &out, uint64_t value)
+            {
+                for (int shift = 0; shift < 64; shift += 8)
+                {
+                    out.push_back(static_cast<uint8_t>(value >> shift));
+                }
+            }
+
+            uint64_t read_uint64(uint8_t const *in)
+            {
+                uint64_t value = 0;
+                for (int i = 7; i >= 0; --i)
+                {
+                    value = value << 8 | in[i];
+                }
+                return value;
+            }
+
+            std::vector<uint8_t> header(txtz const &z, table_t table)
+            {
+                return {uint8_t(MAGIC[0]), uint8_t(MAGIC[1]), uint8_t(MAGIC[2]), uint8_t(MAGIC[3]),
+                        VERSION,
+                        static_cast<uint8_t>(z.framing()),
+                        static_cast<uint8_t>(z.normalization()),
+                        static_cast<uint8_t>(table)};
+            }
+        }
+
+        table_t table_from_string(std::string const &name)
+        {
+            if (name == "huffman")
+                return table_t::huffman;
+            if (name == "shannon-fano")
+                return table_t::shannon_fano;
+            return table_t::unknown;
+        }
+
+        void compress_block(txtz const &z, std::string_view in, std::vector<uint8_t> &out, std::size_t &bits)
+        {
+            // the decoder would stop at the first stop token in the input
+            if (z.framing() == txtz::framing_t::stop_token && in.find(txtz::STOP_TOKEN) != std::string_view::npos)
+                throw std::invalid_argument("input contains the stop token");
+            out.resize(z.compress_bound(in.size()));
+            out.resize(z.compress(in, out.data(), out.size(), bits));
+        }
+
+        writer::writer(std::ostream &out, txtz const &z, table_t table)
+            : out_(out)
+        {
+            auto const &h = header(z, table);
+            out_.write(reinterpret_cast<char const *>(h.data()), static_cast<std::streamsize>(h.size()));
+            offset_ = h.size();
+        }
+
+        void writer::append(uint8_t const *data, std::size_t size, std::size_t length)
+        {
+            append_uint64(index_, offset_);
+            append_uint64(index_, length);
+            out_.write(reinterpret_cast<char const *>(data), static_cast<std::streamsize>(size));
+            offset_ += size;
+        }
+
+        void writer::finish()
+        {
+            append_uint64(index_, index_.size() / ENTRY_SIZE);
+            index_.insert(std::end(index_), std::begin(MAGIC), std::end(MAGIC));
+            out_.write(reinterpret_cast<char const *>(index_.data()), static_cast<std::streamsize>(index_.size()));
+            offset_ += index_.size();
+            index_.clear();
+        }
+
+        reader::reader(uint8_t const *data, std::size_t size, txtz const &z, table_t table)
+            : z_(z), data_(data)
+        {
+            if (size < HEADER_SIZE + TRAILER_SIZE)
+                throw std::out_of_range("container truncated");
+            auto const &h = header(z, table);
+            if (!std::equal(std::begin(MAGIC), std::end(MAGIC), data) || !std::equal(std::begin(MAGIC), std::end(MAGIC), data + size - sizeof(MAGIC)))
+                throw std::out_of_range("not a txtz container");
+            if (data[4] != VERSION)
+                throw std::out_of_range("unsupported container version");
+            if (data[5] != h[5] || data[6] != h[6])
+                throw std::invalid_argument("container was compressed with another framing or normalization");
+            if (data[7] != h[7] && data[7] != uint8_t(table_t::unknown) && h[7] != uint8_t(table_t::unknown))
+                throw std::invalid_argument("container was compressed with another code table");
+            const uint64_t count = read_uint64(data + size - TRAILER_SIZE);
+            if (count > (size - HEADER_SIZE - TRAILER_SIZE) / ENTRY_SIZE)
+                throw std::out_of_range("invalid block count");
+            count_ = static_cast<std::size_t>(count);
+            blocks_end_ = size - TRAILER_SIZE - count_ * ENTRY_SIZE;
+            index_ = data + blocks_end_;
+            // check the whole index once, so that accessing a block needs no further checks
+            std::size_t prev = HEADER_SIZE;
+            for (std::size_t i = 0; i < count_; ++i)
+            {
+                const uint64_t off = read_uint64(index_ + ENTRY_SIZE * i);
+                if (off < prev || off >= blocks_end_)
+                    throw std::out_of_range("invalid block offset");
+                prev = static_cast<std::size_t>(off);
+            }
+            for (std::size_t i = 0; i < count_; ++i)
+            {
+                // every code has at least one bit, so a block can't hold more tokens than bits
+                const uint64_t len = read_uint64(index_ + ENTRY_SIZE * i + 8);
+                if (len / z_.max_token_length() > 8 * uint64_t(offset(i + 1) - offset(i)))
+                    throw std::out_of_range("invalid block length");
+                total_length_ += static_cast<std::size_t>(len);
+            }
+        }
+
+        std::size_t reader::offset(std::size_t i) const
+        {
+            return i == count_ ? blocks_end_ : static_cast<std::size_t>(read_uint64(index_ + ENTRY_SIZE * i));
+        }
+
+        std::size_t reader::length(std::size_t i) const
+        {
+            if (i >= count_)
+                throw std::out_of_range("no such block");
+            return static_cast<std::size_t>(read_uint64(index_ + ENTRY_SIZE * i + 8));
+        }
+
+        std::size_t reader::decompress(std::size_t i, char *out, std::size_t capacity) const
+        {
+            const std::size_t expected = length(i);
+            if (capacity < expected)
+                throw std::length_error("output buffer too small");
+            const std::size_t begin = offset(i);
+            std::size_t n;
+            try
+            {
+                n = z_.decompress(data_ + begin, offset(i + 1) - begin, out, expected);
+            }
+            catch (std::length_error const &)
+            {
+                throw std::out_of_range("block decodes to more data than its index entry says");
+            }
+            if (n != expected)
+                throw std::out_of_range("block decodes to less data than its index entry says");
+            return n;
+        }
+    }
+}
@@ -0,0 +1,183 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __CONTAINER_HPP__
+#define __CONTAINER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * Large inputs are stored as a sequence of independently compressed
+     * blocks followed by an index, so that they can be compressed and
+     * decompressed in parallel and any block can be decoded on its own:
+     *
+     *     header | block 0 | ... | block n-1 | entry 0 | ... | entry n-1 | n | magic
+     *
+     * The header is the magic "TXTZ", the format version, the framing
+     * and normalization of the dictionary and the code table, one byte
+     * each. Every index
+     * entry holds the offset of a block from the start of the file and
+     * the length of its uncompressed data. These and the number of blocks
+     * `n` are 64 bit little endian numbers.
+     */
+    namespace container
+    {
+        constexpr char MAGIC[4] = {'T', 'X', 'T', 'Z'};
+        constexpr uint8_t VERSION = 1;
+        constexpr std::size_t HEADER_SIZE = 8;
+        constexpr std::size_t ENTRY_SIZE = 16;
+        constexpr std::size_t TRAILER_SIZE = 12;
+
+        /**
+         * The built-in code table the blocks were compressed with, so that
+         * they aren't decoded with the codes of the other one. Containers
+         * compressed with any other table, or by older versions, store
+         * `unknown` and can't be checked.
+         */
+        enum class table_t : uint8_t
+        {
+            unknown = 0,
+            huffman = 1,
+            shannon_fano = 2,
+        };
+
+        /**
+         * @return the table built with the algorithm `name`, i.e. "huffman"
+         * or "shannon-fano", `table_t::unknown` for any other name
+         */
+        table_t table_from_string(std::string const &name);
+
+        /**
+         * Compress `in` as one block, thread-safe like `txtz::compress()`.
+         *
+         * @param bits receives the number of bits written
+         * @throw std::invalid_argument if the input contains a character without code,
+         * or, with stop token framing, the stop token
+         */
+        void compress_block(txtz const &z, std::string_view in, std::vector<uint8_t> &out, std::size_t &bits);
+
+        /**
+         * Appends compressed blocks to a stream and finishes it with the index.
+         */
+        class writer final
+        {
+        public:
+            /**
+             * Write the header for data compressed with `z` and its code `table`.
+             */
+            writer(std::ostream &out, txtz const &z, table_t table = table_t::unknown);
+
+            /**
+             * Append a block compressed from `length` bytes.
+             */
+            void append(uint8_t const *data, std::size_t size, std::size_t length);
+
+            /**
+             * Write the index; don't append any more blocks afterwards.
+             */
+            void finish();
+
+            /**
+             * @return number of bytes written
+             */
+            std::size_t size() const
+            {
+                return offset_;
+            }
+
+        private:
+            std::ostream &out_;
+            std::size_t offset_{0};
+            std::vector<uint8_t> index_;
+        };
+
+        /**
+         * Gives access to the blocks of a container held in memory, e.g.
+         * in a `mapped_file`. Only the header and the trailer are read on
+         * construction; all member functions are `const` and thread-safe.
+         */
+        class reader final
+        {
+        public:
+            /**
+             * @throw std::out_of_range if the container is truncated or its index is invalid
+             * @throw std::invalid_argument if it was compressed with another framing or normalization than `z` uses,
+             * or with another code table than `table`
+             */
+            reader(uint8_t const *data, std::size_t size, txtz const &z, table_t table = table_t::unknown);
+
+            std::size_t block_count() const
+            {
+                return count_;
+            }
+
+            /**
+             * @return number of uncompressed bytes of block `i`
+             */
+            std::size_t length(std::size_t i) const;
+
+            /**
+             * @return number of uncompressed bytes of all blocks
+             */
+            std::size_t total_length() const
+            {
+                return total_length_;
+            }
+
+            /**
+             * Decompress block `i` into the `capacity` bytes at `out`,
+             * which must hold at least `length(i)` bytes.
+             *
+             * @return number of bytes written to `out`
+             * @throw std::length_error if `out` is too small
+             * @throw std::out_of_range if there's no such block or the compressed data is corrupt
+             */
+            std::size_t decompress(std::size_t i, char *out, std::size_t capacity) const;
+
+        private:
+            txtz z_;
+            uint8_t const *data_;
+            uint8_t const *index_;
+            std::size_t blocks_end_;
+            std::size_t count_;
+            std::size_t total_length_{0};
+
+            std::size_t offset(std::size_t i) const;
+        };
+    }
+}
+
+#endif // __CONTAINER_HPP__
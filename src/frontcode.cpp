@@ -0,0 +1,276 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "frontcode.hpp"
+#include "util.hpp"
+
+namespace txtz
+{
+    namespace
+    {
+        /**
+         * Suffix lengths from this one on continue in a varint of their own.
+         */
+        constexpr std::size_t SHORT_SUFFIX = 15;
+
+        void append_uint32(std::vector<uint8_t> &out, std::size_t value)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                out.push_back(static_cast<uint8_t>(value >> shift));
+            }
+        }
+
+        std::size_t read_uint32(uint8_t const *in)
+        {
+            return std::size_t(in[0]) | std::size_t(in[1]) << 8 | std::size_t(in[2]) << 16 | std::size_t(in[3]) << 24;
+        }
+    }
+
+    front_codec::front_codec(txtz const &z, std::size_t restart_interval)
+        : z_(z), restart_interval_(restart_interval)
+    {
+        if (restart_interval_ == 0 || restart_interval_ > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument("invalid restart interval");
+    }
+
+    std::vector<uint8_t> front_codec::compress(std::vector<std::string_view> const &strings, std::size_t &bits) const
+    {
+        if (strings.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("too many strings for a front coded list");
+        std::vector<uint8_t> out;
+        std::vector<std::size_t> offsets;
+        std::string suffixes;
+        std::vector<uint8_t> buf;
+        bits = 0;
+        for (std::size_t first = 0; first < strings.size(); first += restart_interval_)
+        {
+            offsets.push_back(out.size());
+            const std::size_t last = std::min(strings.size(), first + restart_interval_);
+            const std::size_t header_start = out.size();
+            suffixes.clear();
+            for (std::size_t i = first; i < last; ++i)
+            {
+                const std::string_view s = strings[i];
+                std::size_t shared = 0;
+                if (i > first)
+                {
+                    const std::string_view prev = strings[i - 1];
+                    const std::size_t n = std::min(prev.size(), s.size());
+                    shared = static_cast<std::size_t>(std::mismatch(std::begin(s), std::begin(s) + static_cast<std::ptrdiff_t>(n), std::begin(prev)).first - std::begin(s));
+                    // don't split a UTF-8 sequence, so that normalization sees whole characters
+                    while (shared > 0 && shared < s.size() && (static_cast<uint8_t>(s[shared]) & 0xc0) == 0x80)
+                    {
+                        --shared;
+                    }
+                }
+                const std::size_t length = s.size() - shared;
+                util::append_varint(out, shared << 4 | std::min(length, SHORT_SUFFIX));
+                if (length >= SHORT_SUFFIX)
+                {
+                    util::append_varint(out, length - SHORT_SUFFIX);
+                }
+                suffixes.append(s.substr(shared));
+            }
+            buf.resize(z_.compress_bound(suffixes.size()));
+            std::size_t suffix_bits;
+            const std::size_t size = z_.compress(suffixes, buf.data(), buf.size(), suffix_bits);
+            bits += 8 * (out.size() - header_start) + suffix_bits;
+            out.insert(std::end(out), std::begin(buf), std::begin(buf) + static_cast<std::ptrdiff_t>(size));
+        }
+        if (out.size() > std::numeric_limits<uint32_t>::max())
+            throw std::length_error("front coded list too large");
+        for (auto offset : offsets)
+        {
+            append_uint32(out, offset);
+        }
+        append_uint32(out, restart_interval_);
+        append_uint32(out, strings.size());
+        bits += 32 * (offsets.size() + 2);
+        return out;
+    }
+
+    std::size_t front_codec::layout::offset(std::size_t i) const
+    {
+        if (i == block_count)
+            return blocks_size;
+        const std::size_t offset = read_uint32(offsets + 4 * i);
+        if (offset >= blocks_size)
+            throw std::out_of_range("invalid block offset");
+        return offset;
+    }
+
+    front_codec::layout front_codec::parse(uint8_t const *in, std::size_t size)
+    {
+        if (size < 8)
+            throw std::out_of_range("front coded list truncated");
+        layout l;
+        l.interval = read_uint32(in + size - 8);
+        l.count = read_uint32(in + size - 4);
+        if (l.interval == 0)
+            throw std::out_of_range("invalid restart interval");
+        l.block_count = l.count / l.interval + (l.count % l.interval != 0);
+        if (l.block_count > (size - 8) / 4)
+            throw std::out_of_range("front coded list truncated");
+        l.blocks = in;
+        l.blocks_size = size - 8 - 4 * l.block_count;
+        l.offsets = in + l.blocks_size;
+        // every string has a header of at least one byte
+        if (l.count > l.blocks_size)
+            throw std::out_of_range("front coded list truncated");
+        return l;
+    }
+
+    void front_codec::decode_block(layout const &l, std::size_t i, std::vector<std::string> &strings) const
+    {
+        const std::size_t first = l.offset(i);
+        const std::size_t last = l.offset(i + 1);
+        if (last < first)
+            throw std::out_of_range("invalid block offset");
+        uint8_t const *in = l.blocks + first;
+        std::size_t size = last - first;
+        const std::size_t count = std::min(l.interval, l.count - i * l.interval);
+        std::vector<std::pair<std::size_t, std::size_t>> headers(count);
+        std::size_t total = 0;
+        for (auto &[shared, length] : headers)
+        {
+            std::size_t header;
+            std::size_t header_size = util::read_varint(in, size, header);
+            if (header_size == 0)
+                throw std::out_of_range("invalid string header");
+            in += header_size;
+            size -= header_size;
+            shared = header >> 4;
+            length = header & SHORT_SUFFIX;
+            if (length == SHORT_SUFFIX)
+            {
+                std::size_t rest;
+                header_size = util::read_varint(in, size, rest);
+                if (header_size == 0)
+                    throw std::out_of_range("invalid string header");
+                in += header_size;
+                size -= header_size;
+                length += rest;
+            }
+            total += length;
+        }
+        // every bit may complete a token
+        if (total / z_.max_token_length() > 8 * size)
+            throw std::out_of_range("suffixes exceed what the compressed data can hold");
+        std::string suffixes(total, '\0');
+        if (z_.decompress(in, size, suffixes.data(), suffixes.size()) != total)
+            throw std::out_of_range("suffixes truncated");
+        strings.resize(count);
+        std::size_t pos = 0;
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            auto const [shared, length] = headers[j];
+            if (shared > (j == 0 ? 0 : strings[j - 1].size()))
+                throw std::out_of_range("shared prefix longer than the previous string");
+            if (j > 0)
+            {
+                strings[j].assign(strings[j - 1], 0, shared);
+            }
+            else
+            {
+                strings[j].clear();
+            }
+            strings[j].append(suffixes, pos, length);
+            pos += length;
+        }
+    }
+
+    std::vector<std::string> front_codec::decompress(uint8_t const *in, std::size_t size) const
+    {
+        const layout l = parse(in, size);
+        std::vector<std::string> strings;
+        strings.reserve(l.count);
+        std::vector<std::string> block;
+        for (std::size_t i = 0; i < l.block_count; ++i)
+        {
+            decode_block(l, i, block);
+            std::move(std::begin(block), std::end(block), std::back_inserter(strings));
+        }
+        return strings;
+    }
+
+    std::string front_codec::at(uint8_t const *in, std::size_t size, std::size_t index) const
+    {
+        const layout l = parse(in, size);
+        if (index >= l.count)
+            throw std::out_of_range("no such string");
+        std::vector<std::string> block;
+        decode_block(l, index / l.interval, block);
+        return block[index % l.interval];
+    }
+
+    bool front_codec::find(uint8_t const *in, std::size_t size, std::string_view key, std::size_t &index) const
+    {
+        const layout l = parse(in, size);
+        // find the first block starting with a string not less than `key`; if
+        // `key` is in the list, it's the first string of that block or in the block before
+        std::vector<std::string> block;
+        std::size_t lo = 0;
+        std::size_t hi = l.block_count;
+        while (lo < hi)
+        {
+            const std::size_t mid = lo + (hi - lo) / 2;
+            decode_block(l, mid, block);
+            if (std::string_view(block.front()) < key)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        if (lo > 0)
+        {
+            decode_block(l, lo - 1, block);
+            auto it = std::lower_bound(std::begin(block), std::end(block), key, [](std::string const &s, std::string_view k)
+                                       { return std::string_view(s) < k; });
+            index = (lo - 1) * l.interval + static_cast<std::size_t>(it - std::begin(block));
+            if (it != std::end(block))
+                return *it == key;
+        }
+        else
+        {
+            index = 0;
+        }
+        if (lo == l.block_count)
+            return false;
+        decode_block(l, lo, block);
+        return block.front() == key;
+    }
+}
@@ -0,0 +1,142 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __FRONTCODE_HPP__
+#define __FRONTCODE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * Compresses a list of strings, e.g. a sorted list of names, by
+     * storing for every string the length of the prefix it shares with
+     * its predecessor and only compressing the rest.
+     *
+     * The strings are grouped into blocks of `interval` strings. The first
+     * string of a block shares nothing with its predecessor, so each
+     * block can be decoded on its own:
+     *
+     *     block 0 | ... | block r-1 | offset 0 | ... | offset r-1 | interval | n
+     *
+     * The offsets of the blocks, `interval` and the number of strings `n`
+     * are 32 bit little endian numbers. A block starts with one header per string, a LEB128 varint
+     * holding the shared prefix length shifted left by four bits and the
+     * suffix length in the low four bits; a suffix length of 15 or more is
+     * stored as 15 with the rest following as another varint. The suffixes
+     * are concatenated and compressed as one string, so that they share
+     * the padding and the stop code. A single string is found by binary
+     * search on the first strings of the blocks and decoding one block.
+     */
+    class front_codec final
+    {
+    public:
+        static constexpr std::size_t DEFAULT_RESTART_INTERVAL = 16;
+
+        /**
+         * @throw std::invalid_argument if `restart_interval` is 0
+         */
+        explicit front_codec(txtz const &z, std::size_t restart_interval = DEFAULT_RESTART_INTERVAL);
+
+        std::size_t restart_interval() const
+        {
+            return restart_interval_;
+        }
+
+        /**
+         * Compress `strings`; `find()` requires them to be sorted byte-wise.
+         *
+         * @param bits receives the number of bits written, including headers and restarts
+         * @throw std::length_error if there are 2^32 strings or more, or the result exceeds 4 GiB
+         */
+        std::vector<uint8_t> compress(std::vector<std::string_view> const &strings, std::size_t &bits) const;
+
+        /**
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        std::vector<std::string> decompress(uint8_t const *in, std::size_t size) const;
+
+        /**
+         * Decode string number `index` only.
+         *
+         * @throw std::out_of_range if there's no such string or the compressed data is corrupt
+         */
+        std::string at(uint8_t const *in, std::size_t size, std::size_t index) const;
+
+        /**
+         * Binary search for `key` in a list compressed from byte-wise sorted strings.
+         *
+         * @param index receives the number of the first string not less than `key`
+         * @return whether `key` was found
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        bool find(uint8_t const *in, std::size_t size, std::string_view key, std::size_t &index) const;
+
+    private:
+        txtz z_;
+        std::size_t restart_interval_;
+
+        /**
+         * A compressed list split into its parts.
+         */
+        struct layout
+        {
+            uint8_t const *blocks;
+            std::size_t blocks_size;
+            uint8_t const *offsets;
+            std::size_t block_count;
+            std::size_t interval;
+            std::size_t count;
+
+            /**
+             * @return offset of block `i`, or `blocks_size` for `block_count`
+             * @throw std::out_of_range if the offset is invalid
+             */
+            std::size_t offset(std::size_t i) const;
+        };
+
+        /**
+         * @throw std::out_of_range if the trailer is invalid
+         */
+        static layout parse(uint8_t const *in, std::size_t size);
+
+        /**
+         * Decode block number `i` into `strings`, replacing their content.
+         *
+         * @throw std::out_of_range if the block is invalid
+         */
+        void decode_block(layout const &l, std::size_t i, std::vector<std::string> &strings) const;
+    };
+}
+
+#endif // __FRONTCODE_HPP__
@@ -0,0 +1,172 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __HISTOGRAM_HPP__
+#define __HISTOGRAM_HPP__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+namespace txtz
+{
+    /**
+     * Log-linear latency histogram.
+     *
+     * Every power of two of nanoseconds is divided into `SUB_BUCKETS`
+     * linear buckets, so quantiles are accurate to 1/`SUB_BUCKETS` of
+     * their value. Counters are atomic, so several threads may record
+     * into the same histogram.
+     */
+    class latency_histogram final
+    {
+    public:
+        static constexpr unsigned int SUB_BUCKET_BITS = 3;
+        static constexpr std::size_t SUB_BUCKETS = std::size_t(1) << SUB_BUCKET_BITS;
+        static constexpr std::size_t GROUPS = 64 - SUB_BUCKET_BITS + 1;
+        static constexpr std::size_t BUCKETS = GROUPS * SUB_BUCKETS;
+
+        void record(std::chrono::nanoseconds d)
+        {
+            const uint64_t ns = d.count() > 0 ? static_cast<uint64_t>(d.count()) : 0;
+            buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void merge(latency_histogram const &o)
+        {
+            for (std::size_t i = 0; i < BUCKETS; ++i)
+            {
+                buckets_[i].fetch_add(o.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+
+        uint64_t count() const
+        {
+            uint64_t n = 0;
+            for (auto const &b : buckets_)
+            {
+                n += b.load(std::memory_order_relaxed);
+            }
+            return n;
+        }
+
+        /**
+         * @return upper bound of the bucket holding quantile `q` (0 ≤ q ≤ 1)
+         */
+        std::chrono::nanoseconds percentile(double q) const
+        {
+            const auto rank = static_cast<uint64_t>(q * double(count()));
+            uint64_t n = 0;
+            std::size_t last = 0;
+            for (std::size_t i = 0; i < BUCKETS; ++i)
+            {
+                const uint64_t c = buckets_[i].load(std::memory_order_relaxed);
+                if (c == 0)
+                    continue;
+                last = i;
+                n += c;
+                if (n > rank)
+                    break;
+            }
+            return std::chrono::nanoseconds(upper_bound_of(last));
+        }
+
+        /**
+         * Print one line per non-empty power of two of microseconds.
+         */
+        void print(std::ostream &out) const
+        {
+            std::size_t end = BUCKETS;
+            while (end > 0 && buckets_[end - 1].load(std::memory_order_relaxed) == 0)
+            {
+                --end;
+            }
+            uint64_t pending = 0;
+            uint64_t limit_us = 1;
+            for (std::size_t i = 0; i < end; ++i)
+            {
+                if (upper_bound_of(i) > 1000 * limit_us)
+                {
+                    if (pending > 0)
+                    {
+                        out << "    < " << std::setw(10) << limit_us << " us: " << pending << '\n';
+                        pending = 0;
+                    }
+                    while (upper_bound_of(i) > 1000 * limit_us)
+                    {
+                        limit_us *= 2;
+                    }
+                }
+                pending += buckets_[i].load(std::memory_order_relaxed);
+            }
+            if (pending > 0)
+            {
+                out << "    < " << std::setw(10) << limit_us << " us: " << pending << '\n';
+            }
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+
+        static unsigned int msb(uint64_t v)
+        {
+#if defined(__GNUC__)
+            return 63U - static_cast<unsigned int>(__builtin_clzll(v));
+#else
+            unsigned int n = 0;
+            while (v >>= 1)
+            {
+                ++n;
+            }
+            return n;
+#endif
+        }
+
+        static std::size_t bucket_of(uint64_t ns)
+        {
+            if (ns < SUB_BUCKETS)
+                return static_cast<std::size_t>(ns);
+            const unsigned int shift = msb(ns) - SUB_BUCKET_BITS;
+            return (shift + 1) * SUB_BUCKETS + static_cast<std::size_t>((ns >> shift) & (SUB_BUCKETS - 1));
+        }
+
+        static uint64_t upper_bound_of(std::size_t bucket)
+        {
+            const std::size_t group = bucket / SUB_BUCKETS;
+            const uint64_t sub = bucket % SUB_BUCKETS;
+            if (group == 0)
+                return sub + 1;
+            return (SUB_BUCKETS + sub + 1) << (group - 1);
+        }
+    };
+}
+
+#endif // __HISTOGRAM_HPP__
@@ -25,11 +25,13 @@
 
 */
 
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
 #include <vector>
-#include <queue>
-#include <string>
 
 #include "code.hpp"
+#include "huffman.hpp"
 #include "ngram.hpp"
 
 namespace txtz
@@ -37,76 +39,110 @@ namespace txtz
 
     namespace
     {
-        struct huffman_node
+        /**
+         * Compute Huffman code lengths in place (Moffat & Katajainen, 1995).
+         *
+         * On entry `a` holds the weights in ascending order, on exit it holds
+         * the code length of each symbol, in descending order. The array
+         * doubles as the queue of internal nodes, as parent pointers and
+         * finally as depth counters, so no tree is ever allocated.
+         */
+        void minimum_redundancy_lengths(std::vector<double> &a)
         {
-            ngram_t *ngram{nullptr};
-            float weight;
-            huffman_node *left{nullptr};
-            huffman_node *right{nullptr};
-
-            huffman_node(float weight)
-                : weight(weight) {}
-            huffman_node(ngram_t *ngram, float weight)
-                : ngram(ngram), weight(weight) {}
-        };
-
-        struct weight_comparator
-        {
-            bool operator()(const huffman_node *const a, const huffman_node *const b)
+            const std::size_t n = a.size();
+            if (n == 0)
+                return;
+            if (n == 1)
             {
-                return a->weight > b->weight; // smaller weights have higher priority
-            }
-        };
-
-        void generate_codes(const huffman_node *const root, const code &prefix, std::vector<ngram_t> const &ngrams)
-        {
-            if (root == nullptr)
+                a[0] = 1;
                 return;
-            if (root->ngram != nullptr)
+            }
+            // first pass, left to right: merge leaves and internal nodes,
+            // replacing consumed internal nodes by their parent's index
+            std::size_t root = 0;
+            std::size_t leaf = 2;
+            a[0] += a[1];
+            for (std::size_t next = 1; next < n - 1; ++next)
             {
-                root->ngram->c = prefix;
+                if (leaf >= n || a[root] < a[leaf])
+                {
+                    a[next] = a[root];
+                    a[root++] = static_cast<double>(next);
+                }
+                else
+                {
+                    a[next] = a[leaf++];
+                }
+                if (leaf >= n || (root < next && a[root] < a[leaf]))
+                {
+                    a[next] += a[root];
+                    a[root++] = static_cast<double>(next);
+                }
+                else
+                {
+                    a[next] += a[leaf++];
+                }
+            }
+            // second pass, right to left: turn parent pointers into depths of internal nodes
+            a[n - 2] = 0;
+            for (std::size_t next = n - 2; next-- > 0;)
+            {
+                a[next] = a[static_cast<std::size_t>(a[next])] + 1;
+            }
+            // third pass, right to left: derive leaf depths from internal node depths
+            std::size_t available = 1;
+            std::size_t used = 0;
+            std::size_t depth = 0;
+            std::size_t internal = n - 1; // one past the next internal node to look at
+            std::size_t next = n;         // one past the next leaf to assign
+            while (available > 0)
+            {
+                while (internal > 0 && static_cast<std::size_t>(a[internal - 1]) == depth)
+                {
+                    ++used;
+                    --internal;
+                }
+                while (available > used)
+                {
+                    a[--next] = static_cast<double>(depth);
+                    --available;
+                }
+                available = 2 * used;
+                ++depth;
+                used = 0;
             }
-            generate_codes(root->left, prefix + 0, ngrams);
-            generate_codes(root->right, prefix + 1, ngrams);
-        }
-
-        static void delete_tree(huffman_node *node)
-        {
-            if (node == nullptr)
-                return;
-            delete_tree(node->left);
-            delete_tree(node->right);
-            delete node;
         }
     }
 
     void huffman(std::vector<ngram_t> &ngrams)
     {
-        std::priority_queue<huffman_node *, std::vector<huffman_node *>, weight_comparator> pq;
-
-        for (auto &ngram : ngrams)
-        {
-            pq.push(new huffman_node(&ngram, ngram.weight));
-        }
-
-        while (pq.size() > 1)
+        if (ngrams.empty())
+            return;
+        std::sort(std::begin(ngrams), std::end(ngrams), [](ngram_t const &a, ngram_t const &b)
+                  { return a.weight < b.weight || (a.weight == b.weight && a.token > b.token); });
+
+        std::vector<double> lengths(ngrams.size());
+        std::transform(std::begin(ngrams), std::end(ngrams), std::begin(lengths), [](ngram_t const &ngram)
+                       { return static_cast<double>(ngram.weight); });
+        minimum_redundancy_lengths(lengths);
+
+        // canonical code assignment, shortest codes first
+        if (static_cast<std::size_t>(lengths.front()) > 8 * sizeof(code_t))
+            throw std::length_error("Huffman code exceeds maximum code length");
+        code_t bits = 0;
+        std::size_t prev_length = static_cast<std::size_t>(lengths.back());
+        for (std::size_t i = ngrams.size(); i-- > 0;)
         {
-            // Extract two nodes with the lowest weight
-            huffman_node *left = pq.top();
-            pq.pop();
-            huffman_node *right = pq.top();
-            pq.pop();
-
-            // Create a new internal node with these two nodes as children
-            huffman_node *top = new huffman_node(left->weight + right->weight);
-            top->left = left;
-            top->right = right;
-
-            pq.push(top); // Add this node to the priority queue
+            const std::size_t length = static_cast<std::size_t>(lengths[i]);
+            bits <<= (length - prev_length);
+            prev_length = length;
+            code c;
+            for (std::size_t b = length; b-- > 0;)
+            {
+                c.append(((bits >> b) & 1) != 0);
+            }
+            ngrams[i].c = c;
+            ++bits;
         }
-
-        // Now pq contains only the root of the Huffman tree
-        generate_codes(pq.top(), code{}, ngrams);
-        delete_tree(pq.top());
     }
 }
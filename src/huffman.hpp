@@ -34,12 +34,18 @@
 namespace txtz
 {
     /**
-     * Using the Huffman algorithm, build a binary tree with all of the n-grams given.
+     * Using the Huffman algorithm, assign a canonical prefix code to all of the n-grams given.
+     *
+     * The n-grams are sorted by ascending weight, code lengths are computed
+     * in place and then turned into canonical codes, i.e. codes of equal
+     * length are consecutive binary numbers. The only allocation is one
+     * work array holding a `double` per n-gram.
      *
      * Update `txtz::code` field of each n-gram to reflect
      * the path to the corresponding node in the binary tree.
      *
-     * @param p sorted list of n-grams
+     * @param ngrams list of n-grams, will be reordered
+     * @throw std::length_error if a code would exceed the width of `code_t`
      */
     void huffman(std::vector<ngram_t> &ngrams);
 }
@@ -0,0 +1,213 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "code.hpp"
+#include "libtxtz.h"
+#include "mappings.hpp"
+#include "txtz.hpp"
+
+struct txtz_dict
+{
+    /**
+     * Shared with every context created from this dictionary.
+     */
+    std::shared_ptr<txtz::txtz::dictionary const> dict;
+};
+
+struct txtz_ctx
+{
+    explicit txtz_ctx(txtz_dict const &dict)
+        : z(dict.dict)
+    {
+    }
+
+    txtz::txtz z;
+};
+
+namespace
+{
+    /**
+     * The dictionary returned by `txtz_dict_default()`, null until it has
+     * been built, so that freeing another one doesn't build it.
+     */
+    std::atomic<txtz_dict const *> default_dict{nullptr};
+
+    /**
+     * Run `f` and translate exceptions into `txtz_error` codes.
+     */
+    template <typename F>
+    ptrdiff_t guarded(F f)
+    {
+        try
+        {
+            return static_cast<ptrdiff_t>(f());
+        }
+        catch (std::length_error const &)
+        {
+            return TXTZ_ERROR_BUFFER_TOO_SMALL;
+        }
+        catch (std::out_of_range const &)
+        {
+            return TXTZ_ERROR_CORRUPT_DATA;
+        }
+        catch (std::invalid_argument const &)
+        {
+            return TXTZ_ERROR_INVALID_ARGUMENT;
+        }
+        catch (std::bad_alloc const &)
+        {
+            return TXTZ_ERROR_OUT_OF_MEMORY;
+        }
+        catch (...)
+        {
+            // nothing may propagate into C code
+            return TXTZ_ERROR_INTERNAL;
+        }
+    }
+}
+
+extern "C"
+{
+    const txtz_dict *txtz_dict_default(void)
+    {
+        try
+        {
+            // if building it throws, the next call tries again
+            static const txtz_dict dict{txtz::txtz(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization).shared_dictionary()};
+            default_dict.store(&dict, std::memory_order_release);
+            return &dict;
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    txtz_dict *txtz_dict_new(const char *const *tokens, const size_t *token_lengths,
+                             const uint64_t *codes, const unsigned int *code_lengths, size_t count)
+    {
+        if (tokens == nullptr || token_lengths == nullptr || codes == nullptr || code_lengths == nullptr || count == 0)
+            return nullptr;
+        try
+        {
+            std::unordered_map<std::string, txtz::code> table;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (code_lengths[i] == 0 || code_lengths[i] > 8 * sizeof(txtz::code_t) || token_lengths[i] == 0)
+                    return nullptr;
+                table.emplace(std::string(tokens[i], token_lengths[i]),
+                              txtz::code(code_lengths[i], static_cast<txtz::code_t>(codes[i])));
+            }
+            return new txtz_dict{txtz::txtz(table).shared_dictionary()};
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void txtz_dict_free(txtz_dict *dict)
+    {
+        if (dict != default_dict.load(std::memory_order_acquire))
+        {
+            delete dict;
+        }
+    }
+
+    txtz_ctx *txtz_ctx_new(const txtz_dict *dict)
+    {
+        if (dict == nullptr)
+            return nullptr;
+        try
+        {
+            return new txtz_ctx(*dict);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void txtz_ctx_free(txtz_ctx *ctx)
+    {
+        delete ctx;
+    }
+
+    size_t txtz_compress_bound(const txtz_ctx *ctx, size_t len)
+    {
+        if (ctx == nullptr)
+            return 0;
+        return ctx->z.compress_bound(len);
+    }
+
+    ptrdiff_t txtz_compress(txtz_ctx *ctx, const char *in, size_t len, uint8_t *out, size_t cap)
+    {
+        if (ctx == nullptr || (in == nullptr && len > 0) || (out == nullptr && cap > 0))
+            return TXTZ_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       {
+                           std::size_t bits;
+                           return ctx->z.compress(std::string_view(in, len), out, cap, bits); });
+    }
+
+    ptrdiff_t txtz_decompress(txtz_ctx *ctx, const uint8_t *in, size_t len, char *out, size_t cap)
+    {
+        if (ctx == nullptr || (in == nullptr && len > 0) || (out == nullptr && cap > 0))
+            return TXTZ_ERROR_INVALID_ARGUMENT;
+        return guarded([&]
+                       { return ctx->z.decompress(in, len, out, cap); });
+    }
+
+    const char *txtz_strerror(int error)
+    {
+        switch (error)
+        {
+        case TXTZ_OK:
+            return "success";
+        case TXTZ_ERROR_BUFFER_TOO_SMALL:
+            return "output buffer too small";
+        case TXTZ_ERROR_CORRUPT_DATA:
+            return "compressed data is corrupt";
+        case TXTZ_ERROR_INVALID_ARGUMENT:
+            return "invalid argument";
+        case TXTZ_ERROR_OUT_OF_MEMORY:
+            return "out of memory";
+        case TXTZ_ERROR_INTERNAL:
+            return "internal error";
+        default:
+            return "unknown error";
+        }
+    }
+}
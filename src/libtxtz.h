@@ -0,0 +1,132 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __LIBTXTZ_H__
+#define __LIBTXTZ_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * Error codes returned (negated) by the functions below.
+     */
+    enum txtz_error
+    {
+        TXTZ_OK = 0,
+        /** The output buffer is too small. */
+        TXTZ_ERROR_BUFFER_TOO_SMALL = -1,
+        /** The compressed data is truncated or contains invalid codes. */
+        TXTZ_ERROR_CORRUPT_DATA = -2,
+        /** The input contains a character the dictionary has no code for, or an argument is invalid. */
+        TXTZ_ERROR_INVALID_ARGUMENT = -3,
+        /** Memory could not be allocated. */
+        TXTZ_ERROR_OUT_OF_MEMORY = -4,
+        /** Any other failure inside the library. */
+        TXTZ_ERROR_INTERNAL = -5,
+    };
+
+    /**
+     * A code table mapping tokens to prefix-free codes.
+     */
+    typedef struct txtz_dict txtz_dict;
+
+    /**
+     * Compression state bound to a dictionary. A context must not be
+     * used by more than one thread at a time; create one per thread.
+     * Contexts share the dictionary's tables, so they are cheap to create.
+     */
+    typedef struct txtz_ctx txtz_ctx;
+
+    /**
+     * @return the dictionary compiled into the library, or NULL if it
+     * can't be built, e.g. for lack of memory; must not be freed
+     */
+    const txtz_dict *txtz_dict_default(void);
+
+    /**
+     * Create a dictionary from `count` tokens.
+     *
+     * Token i consists of the `token_lengths[i]` bytes at `tokens[i]`,
+     * its code is made up of the lower `code_lengths[i]` bits of `codes[i]`,
+     * the first bit of the code being the most significant one.
+     * The dictionary uses length-prefixed framing unless it contains the stop token "\xff".
+     * Input is compressed as is; only the default dictionary may normalize it.
+     *
+     * @return new dictionary, or NULL on error
+     */
+    txtz_dict *txtz_dict_new(const char *const *tokens, const size_t *token_lengths,
+                             const uint64_t *codes, const unsigned int *code_lengths, size_t count);
+
+    void txtz_dict_free(txtz_dict *dict);
+
+    /**
+     * Create a context for `dict`. All scratch memory is allocated here,
+     * so the compress and decompress calls don't allocate.
+     * The dictionary can be freed once the context has been created.
+     *
+     * @return new context, or NULL on error
+     */
+    txtz_ctx *txtz_ctx_new(const txtz_dict *dict);
+
+    void txtz_ctx_free(txtz_ctx *ctx);
+
+    /**
+     * @return number of bytes sufficient to hold the compressed form of `len` bytes, 0 if `ctx` is null
+     */
+    size_t txtz_compress_bound(const txtz_ctx *ctx, size_t len);
+
+    /**
+     * Compress the `len` bytes at `in` into the `cap` bytes at `out`.
+     *
+     * @return number of bytes written to `out`, or a negative `txtz_error`
+     */
+    ptrdiff_t txtz_compress(txtz_ctx *ctx, const char *in, size_t len, uint8_t *out, size_t cap);
+
+    /**
+     * Decompress the `len` bytes at `in` into the `cap` bytes at `out`.
+     * Nothing is read beyond `in + len` or written beyond `out + cap`,
+     * even if the data is truncated or corrupt.
+     *
+     * @return number of bytes written to `out`, or a negative `txtz_error`
+     */
+    ptrdiff_t txtz_decompress(txtz_ctx *ctx, const uint8_t *in, size_t len, char *out, size_t cap);
+
+    /**
+     * @return human readable description of a `txtz_error`
+     */
+    const char *txtz_strerror(int error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LIBTXTZ_H__
@@ -26,12 +26,14 @@
 */
 
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <optional>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
@@ -44,8 +46,10 @@
 #include <getopt.hpp>
 
 #include "txtz.hpp"
+#include "normalize.hpp"
 #include "shannon-fano.hpp"
 #include "huffman.hpp"
+#include "spacesaving.hpp"
 #include "util.hpp"
 
 using json = nlohmann::json;
@@ -55,18 +59,608 @@ namespace fs = std::filesystem;
 #define MAP_FILE "mappings"
 #endif
 
+namespace
+{
+    /**
+     * Weights given to tokens that don't come from the input files.
+     */
+    struct weight_params
+    {
+        /**
+         * Weight of the stop token relative to the heaviest token.
+         */
+        float stop_token_weight_factor{1e2f};
+        /**
+         * Weight of missing monograms relative to the lightest token;
+         * if negative, printable characters get `max(min_weight - 1, 1)`,
+         * all others `min_weight / 2`.
+         */
+        float fill_weight_factor{-1.f};
+    };
+
+    std::ostream &operator<<(std::ostream &os, weight_params const &p)
+    {
+        os << "stop token weight factor " << p.stop_token_weight_factor << ", fill weight factor ";
+        if (p.fill_weight_factor < 0)
+        {
+            os << "default";
+        }
+        else
+        {
+            os << p.fill_weight_factor;
+        }
+        return os;
+    }
+
+    /**
+     * Figures describing how well a code table fits the data.
+     */
+    struct table_quality
+    {
+        /**
+         * Bits per input character predicted from the token weights.
+         */
+        double expected_bits_per_char{0};
+        /**
+         * Bits per input character when compressing the held-out corpus,
+         * framing included.
+         */
+        double measured_bits_per_char{0};
+        /**
+         * Weighted average code length in bits.
+         */
+        double avg_code_length{0};
+        /**
+         * Sum of 2^-l over all code lengths l; 1 for a complete code.
+         */
+        double kraft_sum{0};
+        /**
+         * Number of held-out lines that couldn't be compressed.
+         */
+        std::size_t failures{0};
+    };
+
+    std::vector<txtz::ngram_t> make_ngrams(std::unordered_map<std::string, float> tokens,
+                                           float min_weight, float max_weight,
+                                           weight_params const &params,
+                                           bool fill_missing_monograms, bool with_stop_token)
+    {
+        if (fill_missing_monograms)
+        {
+            auto emplace = [&tokens](uint8_t t, float weight)
+            {
+                char c = static_cast<char>(t);
+                std::string token(&c, 1);
+                if (tokens.find(token) == std::end(tokens))
+                {
+                    tokens[token] = weight;
+                }
+            };
+            const float printable_weight = params.fill_weight_factor < 0
+                                               ? std::max(min_weight - 1.f, 1.f)
+                                               : params.fill_weight_factor * min_weight;
+            const float other_weight = params.fill_weight_factor < 0
+                                           ? min_weight / 2
+                                           : params.fill_weight_factor * min_weight / 2;
+            for (uint8_t t = 0; t < 32; ++t)
+            {
+                emplace(t, other_weight);
+            }
+            for (uint8_t t = 32; t < 127; ++t)
+            {
+                emplace(t, printable_weight);
+            }
+            for (uint8_t t = 127; t < 255; ++t)
+            {
+                emplace(t, other_weight);
+            }
+        }
+        if (with_stop_token)
+        {
+            tokens[std::string(&txtz::txtz::STOP_TOKEN, 1)] = params.stop_token_weight_factor * max_weight;
+        }
+        std::vector<txtz::ngram_t> ngrams;
+        ngrams.reserve(tokens.size());
+        std::transform(std::begin(tokens), std::end(tokens), std::back_inserter(ngrams), [](decltype(tokens)::value_type it) -> txtz::ngram_t
+                       { return txtz::ngram_t{it.first, it.second}; });
+        return ngrams;
+    }
+
+    /**
+     * Build codes with the algorithm `algo`, i.e. "huffman" or "shannon-fano".
+     */
+    void assign_codes(std::vector<txtz::ngram_t> &ngrams, std::string const &algo)
+    {
+        if (algo == "shannon-fano")
+        {
+            txtz::shannon_fano(ngrams);
+        }
+        else
+        {
+            txtz::huffman(ngrams);
+        }
+    }
+
+    /**
+     * Convert the n-grams into a table as generated into the C++ map file,
+     * i.e. with the first bit of each code in the most significant position.
+     */
+    std::unordered_map<std::string, txtz::code> compression_table_of(std::vector<txtz::ngram_t> const &ngrams)
+    {
+        std::unordered_map<std::string, txtz::code> table;
+        table.reserve(ngrams.size());
+        for (auto const &ngram : ngrams)
+        {
+            table.emplace(ngram.token, ngram.c.reversed());
+        }
+        return table;
+    }
+
+    /**
+     * Add `weight` to the folded `token` and to each capitalization marker
+     * in it. The markers become tokens of their own, so that the folded
+     * words can share their codes with the lower case ones.
+     */
+    template <typename AddT>
+    void add_folded(AddT const &add, std::string const &token, float weight, std::string &folded)
+    {
+        txtz::normalize::fold(token.data(), token.size(), folded);
+        for (char marker : {txtz::normalize::CAPITAL, txtz::normalize::ALL_CAPITALS, txtz::normalize::ESCAPE})
+        {
+            const auto n = std::count(std::begin(folded), std::end(folded), marker);
+            if (n > 0)
+            {
+                add(std::string(&marker, 1), weight * static_cast<float>(n));
+                folded.erase(std::remove(std::begin(folded), std::end(folded), marker), std::end(folded));
+            }
+        }
+        if (!folded.empty())
+        {
+            add(folded, weight);
+        }
+    }
+
+    /**
+     * Rate the codes assigned to `ngrams`. If `heldout` isn't empty, every
+     * line of it is compressed separately with the real tokenizer.
+     */
+    table_quality evaluate(std::vector<txtz::ngram_t> const &ngrams, std::vector<std::string> const &heldout,
+                           txtz::txtz::normalization_t normalization)
+    {
+        table_quality q;
+        double weights = 0;
+        double weighted_bits = 0;
+        double weighted_chars = 0;
+        for (auto const &ngram : ngrams)
+        {
+            q.kraft_sum += std::ldexp(1.0, -static_cast<int>(ngram.c.bitcount()));
+            weights += ngram.weight;
+            weighted_bits += double(ngram.weight) * double(ngram.c.bitcount());
+            // the stop token costs bits but doesn't stand for any input
+            if (ngram.token.size() != 1 || ngram.token.front() != txtz::txtz::STOP_TOKEN)
+            {
+                weighted_chars += double(ngram.weight) * double(ngram.token.size());
+            }
+        }
+        if (weights > 0)
+        {
+            q.avg_code_length = weighted_bits / weights;
+            q.expected_bits_per_char = weighted_bits / weighted_chars;
+        }
+        if (heldout.empty())
+            return q;
+        const txtz::txtz z(compression_table_of(ngrams), normalization);
+        std::vector<uint8_t> buffer;
+        std::size_t total_bits = 0;
+        std::size_t total_chars = 0;
+        for (auto const &line : heldout)
+        {
+            buffer.resize(z.compress_bound(line.size()));
+            std::size_t bits;
+            try
+            {
+                z.compress(line, buffer.data(), buffer.size(), bits);
+            }
+            catch (std::invalid_argument const &)
+            {
+                ++q.failures;
+                continue;
+            }
+            total_bits += bits;
+            total_chars += line.size();
+        }
+        if (total_chars > 0)
+        {
+            q.measured_bits_per_char = double(total_bits) / double(total_chars);
+        }
+        return q;
+    }
+
+    /**
+     * @return lowest and highest weight of all `tokens`, which must not be empty
+     */
+    std::pair<float, float> weight_range(std::unordered_map<std::string, float> const &tokens)
+    {
+        auto const [min, max] = std::minmax_element(
+            std::begin(tokens), std::end(tokens),
+            [](auto const &p1, auto const &p2)
+            {
+                return p1.second < p2.second;
+            });
+        return {min->second, max->second};
+    }
+
+    /**
+     * Write the n-grams as initializer list of a C++ `unordered_map`, shortest codes first.
+     */
+    void write_table(std::ostream &cpp, std::vector<txtz::ngram_t> &ngrams, std::string const &indent)
+    {
+        std::sort(std::begin(ngrams), std::end(ngrams), [](txtz::ngram_t const &a, txtz::ngram_t const &b)
+                  { return a.c.bitcount() < b.c.bitcount(); });
+        cpp << indent << "{\n";
+        for (auto const &ngram : ngrams)
+        {
+            cpp << indent << "  {\"" << util::escaped(ngram.token) << "\", code(" << std::dec << ngram.c.bitcount() << ", 0b" << ngram.c.str() << ")},\n";
+        }
+        cpp << indent << "}";
+    }
+
+    /**
+     * Generates C++ source for an encoder and a decoder specialized for one
+     * code table, see `txtz::txtz::specialization`.
+     *
+     * The encoder finds the longest token with nested `switch` statements
+     * over the input bytes, with every code as an immediate. The decoder
+     * looks at up to `ROOT_BITS` bits of the stream at once and dispatches
+     * on them; codes that are longer continue in nested switches over the
+     * following `INNER_BITS` bits. Tokens are copied with `memcpy()` of a
+     * fixed size.
+     */
+    class specializer
+    {
+    public:
+        static constexpr unsigned int ROOT_BITS = 10;
+        static constexpr unsigned int INNER_BITS = 6;
+        /**
+         * Longest code the decoder can handle; a refilled `bit_reader` holds at least 57 bits.
+         */
+        static constexpr unsigned long MAX_CODE_LENGTH = 56;
+
+        /**
+         * @throw std::invalid_argument if the codes are too long or not prefix-free
+         */
+        specializer(std::unordered_map<std::string, txtz::code> const &table, bool with_stop_token)
+            : with_stop_token_(with_stop_token)
+        {
+            for (auto const &[token, c] : table)
+            {
+                if (c.bitcount() == 0 || c.bitcount() > MAX_CODE_LENGTH)
+                    throw std::invalid_argument("code length out of range for a specialized decoder");
+                entries_.push_back(entry{token, c.bits(), c.bitcount()});
+            }
+            std::sort(std::begin(entries_), std::end(entries_), [](entry const &a, entry const &b)
+                      { return a.token < b.token; });
+            nodes_.emplace_back();
+            for (std::size_t i = 0; i < entries_.size(); ++i)
+            {
+                std::size_t n = 0;
+                for (unsigned long bit = entries_[i].length; bit-- > 0;)
+                {
+                    if (nodes_[n].entry >= 0)
+                        throw std::invalid_argument("code is not prefix-free");
+                    const int b = static_cast<int>((entries_[i].bits >> bit) & 1);
+                    if (nodes_[n].child[b] < 0)
+                    {
+                        nodes_[n].child[b] = static_cast<int>(nodes_.size());
+                        nodes_.emplace_back();
+                    }
+                    n = static_cast<std::size_t>(nodes_[n].child[b]);
+                }
+                if (nodes_[n].entry >= 0 || nodes_[n].child[0] >= 0 || nodes_[n].child[1] >= 0)
+                    throw std::invalid_argument("code is not prefix-free");
+                nodes_[n].entry = static_cast<int>(i);
+            }
+            height(0);
+        }
+
+        /**
+         * Write both functions and the `specialization` referring to them.
+         */
+        void write(std::ostream &cpp) const
+        {
+            cpp << "    namespace {\n";
+            write_encoder(cpp);
+            write_decoder(cpp);
+            cpp << "    const txtz::specialization specialized{txtz::framing_t::"
+                << (with_stop_token_ ? "stop_token" : "length_prefix")
+                << ", specialized_encode, specialized_decode};\n"
+                << "    }\n";
+        }
+
+    private:
+        struct entry
+        {
+            std::string token;
+            txtz::code_t bits;
+            unsigned long length;
+        };
+
+        struct node
+        {
+            int child[2]{-1, -1};
+            /**
+             * Index of the entry whose code ends here, -1 for inner nodes.
+             */
+            int entry{-1};
+            unsigned int height{0};
+        };
+
+        bool with_stop_token_;
+        std::vector<entry> entries_;
+        std::vector<node> nodes_;
+
+        unsigned int height(std::size_t n)
+        {
+            unsigned int h = 0;
+            for (int c : nodes_[n].child)
+            {
+                if (c >= 0)
+                {
+                    h = std::max(h, 1 + height(static_cast<std::size_t>(c)));
+                }
+            }
+            nodes_[n].height = h;
+            return h;
+        }
+
+        bool is_stop_token(entry const &e) const
+        {
+            return with_stop_token_ && e.token.size() == 1 && e.token.front() == txtz::txtz::STOP_TOKEN;
+        }
+
+        static std::string hex(uint64_t value)
+        {
+            std::ostringstream oss;
+            oss << "0x" << std::hex << value;
+            return oss.str();
+        }
+
+        void write_encoder(std::ostream &cpp) const
+        {
+            cpp << "    std::size_t specialized_encode(char const *in, std::size_t size, uint8_t *out, std::size_t capacity, std::size_t &bits)\n"
+                << "    {\n"
+                << "        bit_writer writer(out, capacity);\n"
+                << "        bits = 0;\n"
+                << "        char const *it = in;\n"
+                << "        char const *const last = in + size;\n"
+                << "        while (it != last)\n"
+                << "        {\n"
+                << "            const std::size_t left = static_cast<std::size_t>(last - it);\n"
+                << "            code_t value = 0;\n"
+                << "            unsigned long length = 0;\n"
+                << "            std::size_t n = 0;\n";
+            // the empty token can't be matched
+            auto first = std::find_if(std::begin(entries_), std::end(entries_), [](entry const &e)
+                                      { return !e.token.empty(); });
+            write_match(cpp, static_cast<std::size_t>(first - std::begin(entries_)), entries_.size(), 0, "            ");
+            cpp << "            if (n == 0)\n"
+                << "                throw std::invalid_argument(\"input contains a character without code\");\n"
+                << "            writer.put(value, length);\n"
+                << "            bits += length;\n"
+                << "            it += n;\n"
+                << "        }\n";
+            if (with_stop_token_)
+            {
+                auto const stop = std::find_if(std::begin(entries_), std::end(entries_), [this](entry const &e)
+                                               { return is_stop_token(e); });
+                if (stop == std::end(entries_))
+                    throw std::invalid_argument("stop token missing");
+                cpp << "        writer.put(" << hex(stop->bits) << "U, " << stop->length << ");\n"
+                    << "        bits += " << stop->length << ";\n";
+            }
+            cpp << "        return writer.finish();\n"
+                << "    }\n";
+        }
+
+        /**
+         * Switch over byte `depth` of the tokens in `[first, last)`, which
+         * share their first `depth` bytes and are all longer than that.
+         */
+        void write_match(std::ostream &cpp, std::size_t first, std::size_t last, std::size_t depth, std::string const &indent) const
+        {
+            cpp << indent << "switch (static_cast<unsigned char>(it[" << depth << "]))\n"
+                << indent << "{\n";
+            while (first != last)
+            {
+                const unsigned char byte = static_cast<unsigned char>(entries_[first].token[depth]);
+                std::size_t group_last = first;
+                while (group_last != last && static_cast<unsigned char>(entries_[group_last].token[depth]) == byte)
+                {
+                    ++group_last;
+                }
+                cpp << indent << "case " << hex(byte) << ":\n";
+                std::size_t longer = first;
+                if (entries_[first].token.size() == depth + 1)
+                {
+                    cpp << indent << "    value = " << hex(entries_[first].bits) << "U;\n"
+                        << indent << "    length = " << entries_[first].length << ";\n"
+                        << indent << "    n = " << (depth + 1) << ";\n";
+                    ++longer;
+                }
+                if (longer != group_last)
+                {
+                    cpp << indent << "    if (left > " << (depth + 1) << ")\n"
+                        << indent << "    {\n";
+                    write_match(cpp, longer, group_last, depth + 1, indent + "        ");
+                    cpp << indent << "    }\n";
+                }
+                cpp << indent << "    break;\n";
+                first = group_last;
+            }
+            cpp << indent << "}\n";
+        }
+
+        void write_decoder(std::ostream &cpp) const
+        {
+            cpp << "    std::size_t specialized_decode(uint8_t const *in, std::size_t size, char *out, std::size_t capacity)\n"
+                << "    {\n"
+                << "        bit_reader reader(in, size);\n"
+                << "        std::size_t pos = 0;\n";
+            if (with_stop_token_)
+            {
+                cpp << "        for (;;)\n"
+                    << "        {\n"
+                    << "            reader.refill();\n"
+                    << "            if (reader.available() == 0)\n"
+                    << "                throw std::out_of_range(\"compressed data truncated\");\n";
+            }
+            else
+            {
+                cpp << "        while (pos < capacity)\n"
+                    << "        {\n"
+                    << "            reader.refill();\n"
+                    << "            if (reader.available() == 0)\n"
+                    << "                throw std::out_of_range(\"compressed data truncated\");\n";
+            }
+            cpp << "            const uint64_t window = reader.window();\n";
+            write_dispatch(cpp, 0, 0, "            ");
+            cpp << "        }\n";
+            if (!with_stop_token_)
+            {
+                cpp << "        return pos;\n";
+            }
+            cpp << "    }\n";
+        }
+
+        /**
+         * Switch over the next bits of the window below inner node `n`,
+         * which is reached after `depth` bits of the current code.
+         */
+        void write_dispatch(std::ostream &cpp, std::size_t n, unsigned int depth, std::string const &indent) const
+        {
+            const unsigned int k = std::min(depth == 0 ? ROOT_BITS : INNER_BITS, nodes_[n].height);
+            cpp << indent << "switch ((window >> " << (64 - depth - k) << ") & " << hex((uint64_t(1) << k) - 1) << ")\n"
+                << indent << "{\n";
+            const std::string body = indent + "    ";
+            for (uint64_t v = 0; v < (uint64_t(1) << k);)
+            {
+                // follow the bits of v until a code ends, the tree ends or k bits are used up
+                int m = static_cast<int>(n);
+                unsigned int j = 0;
+                while (j < k && m >= 0 && nodes_[static_cast<std::size_t>(m)].entry < 0)
+                {
+                    m = nodes_[static_cast<std::size_t>(m)].child[(v >> (k - 1 - j)) & 1];
+                    ++j;
+                }
+                const uint64_t span = uint64_t(1) << (k - j);
+                for (uint64_t u = v; u < v + span; ++u)
+                {
+                    cpp << indent << "case " << hex(u) << ":\n";
+                }
+                if (m < 0)
+                {
+                    write_dead_end(cpp, depth + j, body);
+                }
+                else if (nodes_[static_cast<std::size_t>(m)].entry >= 0)
+                {
+                    write_token(cpp, entries_[static_cast<std::size_t>(nodes_[static_cast<std::size_t>(m)].entry)], body);
+                }
+                else
+                {
+                    write_dispatch(cpp, static_cast<std::size_t>(m), depth + k, body);
+                }
+                v += span;
+            }
+            cpp << indent << "}\n";
+        }
+
+        void write_token(std::ostream &cpp, entry const &e, std::string const &indent) const
+        {
+            if (with_stop_token_)
+            {
+                if (is_stop_token(e))
+                {
+                    cpp << indent << "if (reader.available() < " << e.length << ")\n"
+                        << indent << "    throw std::out_of_range(\"compressed data truncated\");\n"
+                        << indent << "return pos;\n";
+                    return;
+                }
+                cpp << indent << "if (reader.available() < " << e.length << ")\n"
+                    << indent << "    throw std::out_of_range(\"compressed data truncated\");\n"
+                    << indent << "reader.consume(" << e.length << ");\n";
+                if (!e.token.empty())
+                {
+                    cpp << indent << "if (capacity - pos < " << e.token.size() << ")\n"
+                        << indent << "    throw std::length_error(\"output buffer too small\");\n";
+                }
+            }
+            else
+            {
+                cpp << indent << "if (reader.available() < " << e.length << ")\n"
+                    << indent << "    throw std::out_of_range(\"compressed data truncated\");\n"
+                    << indent << "reader.consume(" << e.length << ");\n";
+                if (!e.token.empty())
+                {
+                    cpp << indent << "if (capacity - pos < " << e.token.size() << ")\n"
+                        << indent << "    throw std::out_of_range(\"compressed data exceeds announced length\");\n";
+                }
+            }
+            if (!e.token.empty())
+            {
+                cpp << indent << "std::memcpy(out + pos, \"" << util::escaped(e.token) << "\", " << e.token.size() << ");\n"
+                    << indent << "pos += " << e.token.size() << ";\n";
+            }
+            cpp << indent << "continue;\n";
+        }
+
+        /**
+         * No code starts with the `depth` bits that lead here.
+         */
+        void write_dead_end(std::ostream &cpp, unsigned int depth, std::string const &indent) const
+        {
+            cpp << indent << "if (reader.available() < " << depth << ")\n"
+                << indent << "    throw std::out_of_range(\"compressed data truncated\");\n"
+                << indent << "throw std::out_of_range(\"invalid code in compressed data\");\n";
+        }
+    };
+
+    void print_quality(std::ostream &os, table_quality const &q, bool with_measurement)
+    {
+        os << std::fixed << std::setprecision(3)
+           << "expected " << q.expected_bits_per_char << " bits/char";
+        if (with_measurement)
+        {
+            os << ", measured " << q.measured_bits_per_char << " bits/char";
+        }
+        os << ", avg. code length " << q.avg_code_length
+           << ", Kraft sum " << std::setprecision(6) << q.kraft_sum;
+        if (q.failures > 0)
+        {
+            os << ", " << q.failures << " lines failed";
+        }
+        os << std::defaultfloat;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     using argparser = argparser::argparser;
     std::string table_name = MAP_FILE;
-    float stop_token_weight_factor = 1e2f;
+    weight_params params;
+    fs::path heldout_path;
+    bool with_stop_token = true;
+    bool fold_case = false;
     bool split_by_phomenes = false;
     char phoneme_delim = '|';
     bool fill_missing_monograms = true;
     char histo_delim = ';';
     bool with_histogram = true;
     bool generate_json = false;
+    bool specialize = false;
+    std::size_t max_tokens = 0;
+    std::string algo = "huffman";
     std::vector<fs::path> input_paths;
+    std::vector<fs::path> field_paths;
     int verbosity{};
     bool quiet = false;
     argparser opt(argc, argv);
@@ -92,6 +686,12 @@ int main(int argc, char *argv[])
              {
                  input_paths.push_back(fs::path(arg));
              })
+        .reg({"-f", "--field"}, "INPUT", argparser::required_argument,
+             "Build a dictionary for the next field of a record from this file (see txtz::record_codec). Use once per field.",
+             [&field_paths](std::string const &arg)
+             {
+                 field_paths.push_back(fs::path(arg));
+             })
         .reg({"-m", "--map-file"}, "MAP_FILENAME", argparser::required_argument,
              "Name of C++ and JSON file to generate (default: \"" + table_name + "\").",
              [&table_name](std::string const &arg)
@@ -117,6 +717,54 @@ int main(int argc, char *argv[])
              {
                  with_histogram = false;
              })
+        .reg({"--fold-case"}, argparser::no_argument,
+             "Build the map from NFC-normalized, case-folded text (see txtz::normalize).",
+             [&fold_case](std::string const &)
+             {
+                 fold_case = true;
+             })
+        .reg({"--no-stop-token"}, argparser::no_argument,
+             "Don't add the stop token to the map (for length-prefixed framing).",
+             [&with_stop_token](std::string const &)
+             {
+                 with_stop_token = false;
+             })
+        .reg({"--stop-token-weight-factor"}, "FACTOR", argparser::required_argument,
+             "Weight of the stop token relative to the most frequent token (default: 100).",
+             [&params](std::string const &arg)
+             {
+                 params.stop_token_weight_factor = std::stof(arg);
+             })
+        .reg({"--fill-weight-factor"}, "FACTOR", argparser::required_argument,
+             "Weight of missing monograms relative to the least frequent token.",
+             [&params](std::string const &arg)
+             {
+                 params.fill_weight_factor = std::stof(arg);
+             })
+        .reg({"-a", "--algo"}, "ALGO", argparser::required_argument,
+             "Algorithm building the codes of compression_table: huffman (default) or shannon-fano. Tables with both are generated.",
+             [&algo](std::string const &arg)
+             {
+                 algo = arg;
+             })
+        .reg({"--max-tokens"}, "K", argparser::required_argument,
+             "Count tokens in bounded memory, keeping only the K heaviest ones (default: 0, i.e. count all).",
+             [&max_tokens](std::string const &arg)
+             {
+                 max_tokens = std::stoul(arg);
+             })
+        .reg({"--tune"}, "HELDOUT_FILE", argparser::required_argument,
+             "Try several weight settings, compress each line of this file with them and keep the best.",
+             [&heldout_path](std::string const &arg)
+             {
+                 heldout_path = fs::path(arg);
+             })
+        .reg({"--specialize"}, argparser::no_argument,
+             "Also generate an encoder and a decoder specialized for the map (see txtz::txtz::specialization).",
+             [&specialize](std::string const &)
+             {
+                 specialize = true;
+             })
         .reg({"--json"}, argparser::no_argument,
              "Generate JSON map file in addition to C++ map file.",
              [&generate_json](std::string const &)
@@ -144,71 +792,138 @@ int main(int argc, char *argv[])
         opt.display_help();
         return EXIT_FAILURE;
     }
+    catch (std::exception const &e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
     if (input_paths.empty())
     {
         std::cerr << "\u001b[31;1mERROR: input missing (see option -i)\n";
         return EXIT_FAILURE;
     }
+    if (algo != "huffman" && algo != "shannon-fano")
+    {
+        std::cerr << "\u001b[31;1mERROR: unknown algorithm '" << algo << "'\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    const std::string other_algo = algo == "huffman" ? "shannon-fano" : "huffman";
 
-    std::unordered_map<std::string, float> tokens;
-    for (auto const &input_path : input_paths)
+    const auto normalization = fold_case
+                                   ? txtz::txtz::normalization_t::fold_case
+                                   : txtz::txtz::normalization_t::none;
+    auto read_tokens = [&](std::vector<fs::path> const &paths)
     {
-        auto filenames = glob::glob(input_path.string());
-        while (filenames)
+        std::unordered_map<std::string, float> tokens;
+        // with a limit, only the heaviest tokens are counted, in constant memory
+        std::optional<txtz::space_saving> heavy_hitters;
+        if (max_tokens > 0)
+        {
+            heavy_hitters.emplace(max_tokens);
+        }
+        auto add = [&tokens, &heavy_hitters](std::string const &token, float weight)
         {
-            std::string const &filename = filenames.current_match();
-            filenames.next();
-            if (!fs::exists(input_path.parent_path() / filename))
+            if (heavy_hitters)
             {
-                std::cerr << "\u001b[31;1mERROR: file `"
-                          << (input_path.parent_path() / filename).string()
-                          << "` does not exist\n";
-                continue;
+                heavy_hitters->add(token, weight);
             }
-            if (verbosity > 0 && !quiet)
+            else
             {
-                std::cout
-                    << "\rProcessing " << (input_path.parent_path() / filename).string() << " ... \u001b[K\n"
-                    << std::flush;
+                tokens[token] += weight;
             }
-            std::ifstream in(input_path.parent_path() / filename, std::ios::binary);
-            std::string line;
-            while (std::getline(in, line))
+        };
+        std::string folded;
+        for (auto const &input_path : paths)
+        {
+            auto filenames = glob::glob(input_path.string());
+            while (filenames)
             {
-                line = std::regex_replace(line, std::regex("(\n\r|\r\n|\n)+"), " ");
-                if (with_histogram)
+                std::string const &filename = filenames.current_match();
+                filenames.next();
+                if (!fs::exists(input_path.parent_path() / filename))
                 {
-                    float weight = std::numeric_limits<float>::epsilon();
-                    auto word_histo = util::unpair(line, histo_delim);
-                    try
-                    {
-                        weight = std::stof(word_histo.second);
-                    }
-                    catch (std::invalid_argument const &e)
-                    {
-                        std::cerr << e.what() << " in line " << line << "\"\n";
-                    }
-                    catch (std::out_of_range const &e)
-                    {
-                        std::cerr << e.what() << " in line " << line << "\"\n";
-                    }
-                    if (split_by_phomenes)
+                    std::cerr << "\u001b[31;1mERROR: file `"
+                              << (input_path.parent_path() / filename).string()
+                              << "` does not exist\n";
+                    continue;
+                }
+                if (verbosity > 0 && !quiet)
+                {
+                    std::cout
+                        << "\rProcessing " << (input_path.parent_path() / filename).string() << " ... \u001b[K\n"
+                        << std::flush;
+                }
+                std::ifstream in(input_path.parent_path() / filename, std::ios::binary);
+                std::string line;
+                while (std::getline(in, line))
+                {
+                    line = std::regex_replace(line, std::regex("(\n\r|\r\n|\n)+"), " ");
+                    if (with_histogram)
                     {
-                        for (auto const &ph : util::split(word_histo.first, phoneme_delim))
+                        float weight = std::numeric_limits<float>::epsilon();
+                        auto word_histo = util::unpair(line, histo_delim);
+                        try
                         {
-                            tokens[ph] += weight /* * ph.size() */;
+                            weight = std::stof(word_histo.second);
+                        }
+                        catch (std::invalid_argument const &e)
+                        {
+                            std::cerr << e.what() << " in line " << line << "\"\n";
+                        }
+                        catch (std::out_of_range const &e)
+                        {
+                            std::cerr << e.what() << " in line " << line << "\"\n";
+                        }
+                        if (split_by_phomenes)
+                        {
+                            for (auto const &ph : util::split(word_histo.first, phoneme_delim))
+                            {
+                                if (fold_case)
+                                {
+                                    add_folded(add, ph, weight, folded);
+                                }
+                                else
+                                {
+                                    add(ph, weight /* * ph.size() */);
+                                }
+                            }
+                        }
+                        else
+                        {
+                            word_histo.first.erase(std::remove_if(std::begin(word_histo.first), std::end(word_histo.first), [&phoneme_delim](char c)
+                                                                  { return c == phoneme_delim; }),
+                                                   std::end(word_histo.first));
+                            if (fold_case)
+                            {
+                                add_folded(add, word_histo.first, weight, folded);
+                            }
+                            else
+                            {
+                                add(word_histo.first, weight /* * word_histo.first.size() */);
+                            }
                         }
-                    }
-                    else
-                    {
-                        word_histo.first.erase(std::remove_if(std::begin(word_histo.first), std::end(word_histo.first), [&phoneme_delim](char c)
-                                                              { return c == phoneme_delim; }),
-                                               std::end(word_histo.first));
-                        tokens[word_histo.first] += weight /* * word_histo.first.size() */;
                     }
                 }
             }
         }
+        if (heavy_hitters)
+        {
+            if (verbosity > 0 && !quiet)
+            {
+                std::cout << "Kept " << heavy_hitters->size() << " tokens; all weighing more than "
+                          << heavy_hitters->max_error() << " (of " << heavy_hitters->total_weight()
+                          << " in total) are among them, and no weight is overestimated by more than that.\n";
+            }
+            tokens = heavy_hitters->weights();
+        }
+        return tokens;
+    };
+
+    std::unordered_map<std::string, float> tokens = read_tokens(input_paths);
+    if (tokens.empty())
+    {
+        std::cerr << "\u001b[31;1mERROR: no tokens found in input\u001b[0m\n";
+        return EXIT_FAILURE;
     }
 
     using pair_type = decltype(tokens)::value_type;
@@ -235,63 +950,173 @@ int main(int argc, char *argv[])
         std::cout << std::endl;
     }
 
-    if (fill_missing_monograms)
+    std::vector<std::string> heldout;
+    if (!heldout_path.empty())
     {
-        auto emplace = [&tokens](uint8_t t, float weight) {
-            char c = static_cast<char>(t);
-            std::string token(&c, 1);
-            if (tokens.find(token) == std::end(tokens))
+        std::ifstream in(heldout_path, std::ios::binary);
+        if (!in)
+        {
+            std::cerr << "\u001b[31;1mERROR: cannot open held-out file `" << heldout_path.string() << "`\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        std::string line;
+        while (std::getline(in, line))
+        {
+            line.erase(std::remove_if(std::begin(line), std::end(line), [](char c)
+                                      { return c == '\r' || c == '\n'; }),
+                       std::end(line));
+            if (!line.empty())
             {
-                tokens[token] = weight;
+                heldout.push_back(line);
             }
-        };
-        for (uint8_t t = 0; t < 32; ++t)
+        }
+        if (heldout.empty())
+        {
+            std::cerr << "\u001b[31;1mERROR: held-out file `" << heldout_path.string() << "` is empty\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<txtz::ngram_t> ngrams;
+    if (heldout.empty())
+    {
+        ngrams = make_ngrams(tokens, min_weight, max_weight, params, fill_missing_monograms, with_stop_token);
+        assign_codes(ngrams, algo);
+        if (verbosity > 0 && !quiet)
         {
-            emplace(t, min_weight / 2);
+            print_quality(std::cout, evaluate(ngrams, heldout, normalization), false);
+            std::cout << '\n';
+        }
+    }
+    else
+    {
+        // the given settings are the first candidate, so they win ties
+        std::vector<weight_params> candidates{params};
+        const std::vector<float> stop_factors = with_stop_token
+                                                    ? std::vector<float>{1e-1f, 1.f, 1e1f, 1e2f, 1e3f}
+                                                    : std::vector<float>{params.stop_token_weight_factor};
+        const std::vector<float> fill_factors = fill_missing_monograms
+                                                    ? std::vector<float>{-1.f, 1.f / 256, 1.f / 16, 1.f}
+                                                    : std::vector<float>{params.fill_weight_factor};
+        for (float stop : stop_factors)
+        {
+            for (float fill : fill_factors)
+            {
+                if (stop != params.stop_token_weight_factor || fill != params.fill_weight_factor)
+                {
+                    candidates.push_back(weight_params{stop, fill});
+                }
+            }
         }
-        for (uint8_t t = 32; t < 127; ++t)
+        table_quality best_quality;
+        for (auto const &candidate : candidates)
         {
-            emplace(t, std::max(min_weight - 1.f, 1.f));
+            auto candidate_ngrams = make_ngrams(tokens, min_weight, max_weight, candidate, fill_missing_monograms, with_stop_token);
+            assign_codes(candidate_ngrams, algo);
+            const table_quality q = evaluate(candidate_ngrams, heldout, normalization);
+            if (!quiet)
+            {
+                std::cout << candidate << ": ";
+                print_quality(std::cout, q, true);
+                std::cout << '\n';
+            }
+            if (ngrams.empty() ||
+                q.failures < best_quality.failures ||
+                (q.failures == best_quality.failures && q.measured_bits_per_char < best_quality.measured_bits_per_char))
+            {
+                ngrams = std::move(candidate_ngrams);
+                best_quality = q;
+                params = candidate;
+            }
         }
-        for (uint8_t t = 127; t < 255; ++t)
+        if (!quiet)
         {
-            emplace(t, min_weight / 2);
+            std::cout << "\nBest: " << params << ": ";
+            print_quality(std::cout, best_quality, true);
+            std::cout << "\n\n";
         }
     }
 
-    // emplace stop token
-    tokens[std::string(&txtz::txtz::STOP_TOKEN, 1)] = stop_token_weight_factor * max_weight;
+    // the same tokens and weights with the codes of the other algorithm, so that both can be compared at runtime
+    std::vector<txtz::ngram_t> other_ngrams = ngrams;
+    assign_codes(other_ngrams, other_algo);
+    if (verbosity > 0 && !quiet)
+    {
+        std::cout << other_algo << ": ";
+        print_quality(std::cout, evaluate(other_ngrams, heldout, normalization), !heldout.empty());
+        std::cout << "\n\n";
+    }
 
-    std::vector<txtz::ngram_t> ngrams;
-    std::transform(std::begin(tokens), std::end(tokens), std::back_inserter(ngrams), [](decltype(tokens)::value_type it) -> txtz::ngram_t
-                   { return txtz::ngram_t{it.first, it.second}; });
-
-#if defined(ALGO_HUFFMAN)
-    txtz::huffman(ngrams);
-#elif defined(ALGO_SHANNON_FANO)
-    txtz::shannon_fano(ngrams);
-#else
-#error "Invalid map building algorithm. Define one of ALGO_HUFFMAN or ALGO_SHANNON_FANO!"
-#endif
+    std::vector<std::vector<txtz::ngram_t>> field_ngrams;
+    for (auto const &field_path : field_paths)
+    {
+        const auto field_tokens = read_tokens({field_path});
+        if (field_tokens.empty())
+        {
+            std::cerr << "\u001b[31;1mERROR: no tokens found in field input `" << field_path.string() << "`\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        const auto [field_min_weight, field_max_weight] = weight_range(field_tokens);
+        field_ngrams.push_back(make_ngrams(field_tokens, field_min_weight, field_max_weight, params, fill_missing_monograms, with_stop_token));
+        assign_codes(field_ngrams.back(), algo);
+        if (verbosity > 0 && !quiet)
+        {
+            std::cout << "Field " << (field_ngrams.size() - 1) << ": " << field_tokens.size() << " tokens, ";
+            print_quality(std::cout, evaluate(field_ngrams.back(), {}, normalization), false);
+            std::cout << '\n';
+        }
+    }
 
     if (verbosity > 0 && !quiet)
     {
         std::cout << "Writing ..." << std::flush;
     }
     std::ostringstream cpp;
-    cpp << "#include <string>\n"
+    cpp << "#include <cstdint>\n"
+        << "#include <cstring>\n"
+        << "#include <stdexcept>\n"
+        << "#include <string>\n"
         << "#include <unordered_map>\n"
+        << "#include <vector>\n"
+        << "#include \"bitio.hpp\"\n"
         << "#include \"code.hpp\"\n"
+        << "#include \"txtz.hpp\"\n"
         << "namespace txtz {\n"
-        << "    std::unordered_map<std::string, code> compression_table = {\n";
-
-    std::sort(std::begin(ngrams), std::end(ngrams), [](txtz::ngram_t const &a, txtz::ngram_t const &b)
-                { return a.c.bitcount() < b.c.bitcount(); });
-    for (auto const &ngram : ngrams)
+        << "    std::unordered_map<std::string, code> " << (algo == "huffman" ? "huffman_table" : "shannon_fano_table") << " = \n";
+    write_table(cpp, ngrams, "    ");
+    cpp << ";\n"
+        << "    std::unordered_map<std::string, code> " << (other_algo == "huffman" ? "huffman_table" : "shannon_fano_table") << " = \n";
+    write_table(cpp, other_ngrams, "    ");
+    cpp << ";\n"
+        << "    std::unordered_map<std::string, code> &compression_table = " << (algo == "huffman" ? "huffman_table" : "shannon_fano_table") << ";\n"
+        << "    extern const char *const compression_table_algorithm = \"" << algo << "\";\n"
+        << "    std::vector<std::unordered_map<std::string, code>> record_tables = {\n";
+    for (auto &field : field_ngrams)
+    {
+        write_table(cpp, field, "    ");
+        cpp << ",\n";
+    }
+    cpp << "    };\n"
+        << "    extern const txtz::normalization_t compression_table_normalization = txtz::normalization_t::"
+        << (fold_case ? "fold_case" : "none") << ";\n";
+    if (specialize)
+    {
+        try
+        {
+            specializer(compression_table_of(ngrams), with_stop_token).write(cpp);
+        }
+        catch (std::exception const &e)
+        {
+            std::cerr << "\u001b[31;1mERROR: cannot specialize the map: " << e.what() << "\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        cpp << "    extern const txtz::specialization *const compression_table_specialization = &specialized;\n";
+    }
+    else
     {
-        cpp << "      {\"" << util::escaped(ngram.token) << "\", code(" << std::dec << ngram.c.bitcount() << ", 0b" << ngram.c.str() << ")},\n";
+        cpp << "    extern const txtz::specialization *const compression_table_specialization = nullptr;\n";
     }
-    cpp << "};\n}\n";
+    cpp << "}\n";
     std::ofstream cppout(table_name + ".cpp", std::ios::binary | std::ios::trunc);
     cppout << cpp.str();
 
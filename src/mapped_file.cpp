@@ -0,0 +1,97 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+#include "mapped_file.hpp"
+
+namespace txtz
+{
+#ifdef HAVE_MMAP
+    mapped_file::mapped_file(std::string const &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open '" + path + "': " + std::strerror(errno));
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            throw std::runtime_error("cannot stat '" + path + "': " + std::strerror(error));
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0)
+        {
+            void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                const int error = errno;
+                ::close(fd);
+                throw std::runtime_error("cannot map '" + path + "': " + std::strerror(error));
+            }
+            // the file is mostly read front to back, so let the kernel read ahead
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<uint8_t const *>(p);
+        }
+        // the mapping stays valid after closing the file
+        ::close(fd);
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (data_ != nullptr)
+        {
+            ::munmap(const_cast<uint8_t *>(data_), size_);
+        }
+    }
+#else
+    mapped_file::mapped_file(std::string const &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            throw std::runtime_error("cannot open '" + path + "'");
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+
+    mapped_file::~mapped_file() = default;
+#endif
+}
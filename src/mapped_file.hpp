@@ -0,0 +1,77 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __MAPPED_FILE_HPP__
+#define __MAPPED_FILE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace txtz
+{
+    /**
+     * A file mapped read-only into memory, so that large inputs can be
+     * processed in place by many threads without reading them into
+     * buffers first. Pages are loaded when touched and can be dropped by
+     * the system at any time, so memory usage doesn't grow with the size
+     * of the file. Where `mmap()` isn't available, the file is read into
+     * memory instead.
+     */
+    class mapped_file final
+    {
+    public:
+        /**
+         * @throw std::runtime_error if the file can't be opened or mapped
+         */
+        explicit mapped_file(std::string const &path);
+        mapped_file(mapped_file const &) = delete;
+        mapped_file &operator=(mapped_file const &) = delete;
+        ~mapped_file();
+
+        uint8_t const *data() const
+        {
+            return data_;
+        }
+
+        std::size_t size() const
+        {
+            return size_;
+        }
+
+    private:
+        uint8_t const *data_{nullptr};
+        std::size_t size_{0};
+        /**
+         * Holds the content if the file couldn't be mapped.
+         */
+        std::vector<uint8_t> buffer_;
+    };
+}
+
+#endif // __MAPPED_FILE_HPP__
@@ -1,14 +1,64 @@
 #ifndef __MAPPINGS_HPP__
 #define __MAPPINGS_HPP__
 
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
-#include "shannon-fano.hpp"
+#include "code.hpp"
+#include "txtz.hpp"
 
 namespace txtz
 {
-    const std::unordered_map<std::string, code> compression_table;
+    /**
+     * The tokens of `compression_table` with codes built by Huffman's and
+     * Shannon and Fano's algorithm, respectively.
+     */
+    extern std::unordered_map<std::string, code> huffman_table;
+    extern std::unordered_map<std::string, code> shannon_fano_table;
+    /**
+     * The table built with the algorithm chosen by `MAPBUILDING_ALGO`.
+     */
+    extern std::unordered_map<std::string, code> &compression_table;
+    /**
+     * Name of that algorithm, "huffman" or "shannon-fano".
+     */
+    extern const char *const compression_table_algorithm;
+    /**
+     * One table per field for `record_codec`, empty if the map was built without fields.
+     */
+    extern std::vector<std::unordered_map<std::string, code>> record_tables;
+    /**
+     * How the text `compression_table` was built from was normalized.
+     */
+    extern const txtz::normalization_t compression_table_normalization;
+    /**
+     * Encoder and decoder generated for `compression_table`, null unless
+     * the map was built with `SPECIALIZE`.
+     */
+    extern const txtz::specialization *const compression_table_specialization;
+
+    /**
+     * @return the table built with the algorithm `name`, i.e. "huffman" or "shannon-fano"
+     * @throw std::invalid_argument for any other name
+     */
+    inline std::unordered_map<std::string, code> &compression_table_for(std::string const &name)
+    {
+        if (name == "huffman")
+            return huffman_table;
+        if (name == "shannon-fano")
+            return shannon_fano_table;
+        throw std::invalid_argument("unknown algorithm '" + name + "'");
+    }
+
+    /**
+     * @return `compression_table_specialization` if `table` is `compression_table`, null otherwise
+     */
+    inline txtz::specialization const *specialization_for(std::unordered_map<std::string, code> const &table)
+    {
+        return &table == &compression_table ? compression_table_specialization : nullptr;
+    }
 }
 
 #endif // __MAPPINGS_HPP__
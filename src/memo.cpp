@@ -0,0 +1,172 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <cstring>
+#include <functional>
+
+#include "memo.hpp"
+
+namespace txtz
+{
+    memo_cache::memo_cache(std::size_t capacity)
+        : capacity_(capacity), compressed_(capacity / 2), decompressed_(capacity - capacity / 2)
+    {
+    }
+
+    std::size_t memo_cache::size() const
+    {
+        return compressed_.size() + decompressed_.size();
+    }
+
+    memo_cache::table::table(std::size_t capacity)
+        : shard_capacity_(capacity / SHARDS)
+    {
+    }
+
+    memo_cache::table::shard &memo_cache::table::shard_of(std::string_view key)
+    {
+        return shards_[std::hash<std::string_view>{}(key) % SHARDS];
+    }
+
+    memo_cache::table::slot *memo_cache::table::lookup(shard &s, std::string_view key)
+    {
+        auto it = s.index.find(key);
+        if (it == std::end(s.index))
+            return nullptr;
+        slot &e = s.slots[it->second];
+        e.referenced = true;
+        return &e;
+    }
+
+    bool memo_cache::table::get(std::string_view key, void *out, std::size_t capacity, std::size_t &size, std::size_t &bits)
+    {
+        shard &s = shard_of(key);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            slot const *e = lookup(s, key);
+            if (e != nullptr && e->value.size() <= capacity)
+            {
+                std::memcpy(out, e->value.data(), e->value.size());
+                size = e->value.size();
+                bits = e->bits;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool memo_cache::table::get(std::string_view key, std::string &value)
+    {
+        shard &s = shard_of(key);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            slot const *e = lookup(s, key);
+            if (e != nullptr)
+            {
+                value = e->value;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void memo_cache::table::put(std::string_view key, void const *value, std::size_t size, std::size_t bits)
+    {
+        const std::size_t cost = key.size() + size + ENTRY_OVERHEAD;
+        if (cost > shard_capacity_)
+            return;
+        shard &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        // another thread may have been faster
+        if (s.index.find(key) != std::end(s.index))
+            return;
+        while (s.bytes + cost > shard_capacity_)
+        {
+            evict_one(s);
+        }
+        std::size_t i;
+        if (s.free.empty())
+        {
+            i = s.slots.size();
+            s.slots.emplace_back();
+        }
+        else
+        {
+            i = s.free.back();
+            s.free.pop_back();
+        }
+        slot &e = s.slots[i];
+        e.key.assign(key);
+        e.value.assign(static_cast<char const *>(value), size);
+        e.bits = bits;
+        e.used = true;
+        e.referenced = false;
+        s.index.emplace(e.key, i);
+        s.bytes += cost;
+    }
+
+    void memo_cache::table::evict_one(shard &s)
+    {
+        // only called while `s.bytes` > 0, so there is an entry to evict
+        for (;;)
+        {
+            if (s.hand >= s.slots.size())
+            {
+                s.hand = 0;
+            }
+            const std::size_t i = s.hand++;
+            slot &e = s.slots[i];
+            if (!e.used)
+                continue;
+            if (e.referenced)
+            {
+                e.referenced = false;
+                continue;
+            }
+            s.index.erase(e.key);
+            s.bytes -= e.key.size() + e.value.size() + ENTRY_OVERHEAD;
+            e = slot{};
+            s.free.push_back(i);
+            return;
+        }
+    }
+
+    std::size_t memo_cache::table::size() const
+    {
+        std::size_t bytes = 0;
+        for (auto const &s : shards_)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            bytes += s.bytes;
+        }
+        return bytes;
+    }
+}
@@ -0,0 +1,184 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __MEMO_HPP__
+#define __MEMO_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace txtz
+{
+    /**
+     * A bounded cache of strings and their compressed forms, in both
+     * directions, for inputs that repeat over and over, e.g. frequent names.
+     *
+     * Entries are evicted with the CLOCK algorithm: every entry has a
+     * reference bit, set on each hit; when room is needed, a hand sweeps
+     * over the entries, clearing set bits and evicting the first entry
+     * whose bit is clear. So strings that come up again before the hand
+     * passes by stay, while those seen once make room quickly.
+     *
+     * The cache is split into shards by hash, each with a lock of its own,
+     * so that it can be shared by many threads. Attach it to a `txtz`
+     * handle to use it.
+     */
+    class memo_cache final
+    {
+    public:
+        /**
+         * Approximate bookkeeping cost of an entry besides its bytes.
+         */
+        static constexpr std::size_t ENTRY_OVERHEAD = 128;
+        static constexpr std::size_t SHARDS = 16;
+
+        struct statistics
+        {
+            uint64_t hits;
+            uint64_t misses;
+
+            double hit_rate() const
+            {
+                return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0;
+            }
+        };
+
+        /**
+         * @param capacity number of bytes the cache may occupy, split evenly between both directions
+         */
+        explicit memo_cache(std::size_t capacity);
+        memo_cache(memo_cache const &) = delete;
+        memo_cache &operator=(memo_cache const &) = delete;
+
+        std::size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        /**
+         * @return number of bytes occupied by entries, including `ENTRY_OVERHEAD`
+         */
+        std::size_t size() const;
+
+        statistics compress_statistics() const
+        {
+            return compressed_.statistics();
+        }
+
+        statistics decompress_statistics() const
+        {
+            return decompressed_.statistics();
+        }
+
+    private:
+        friend class txtz;
+
+        /**
+         * Maps keys to values in one direction.
+         */
+        class table
+        {
+        public:
+            explicit table(std::size_t capacity);
+
+            /**
+             * Copy the value of `key` to the `capacity` bytes at `out`.
+             *
+             * @param bits receives the number of bits stored with the value
+             * @return whether `key` was found and its value fits into `out`
+             */
+            bool get(std::string_view key, void *out, std::size_t capacity, std::size_t &size, std::size_t &bits);
+            bool get(std::string_view key, std::string &value);
+            /**
+             * Insert `key` unless it's there already, evicting other entries as needed.
+             */
+            void put(std::string_view key, void const *value, std::size_t size, std::size_t bits);
+            std::size_t size() const;
+
+            memo_cache::statistics statistics() const
+            {
+                return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed)};
+            }
+
+        private:
+            struct slot
+            {
+                std::string key;
+                std::string value;
+                std::size_t bits{0};
+                bool used{false};
+                bool referenced{false};
+            };
+
+            struct alignas(64) shard
+            {
+                mutable std::mutex mutex;
+                /**
+                 * Keys refer to the strings in `slots`, which never move.
+                 */
+                std::unordered_map<std::string_view, std::size_t> index;
+                std::deque<slot> slots;
+                std::vector<std::size_t> free;
+                std::size_t hand{0};
+                std::size_t bytes{0};
+            };
+
+            std::size_t shard_capacity_;
+            shard shards_[SHARDS];
+            std::atomic<uint64_t> hits_{0};
+            std::atomic<uint64_t> misses_{0};
+
+            shard &shard_of(std::string_view key);
+            /**
+             * Find the entry of `key` and set its reference bit.
+             *
+             * @return the entry, or null
+             */
+            slot *lookup(shard &s, std::string_view key);
+            static void evict_one(shard &s);
+        };
+
+        std::size_t capacity_;
+        /**
+         * Maps strings to their compressed forms.
+         */
+        table compressed_;
+        /**
+         * Maps compressed forms to their strings.
+         */
+        table decompressed_;
+    };
+}
+
+#endif // __MEMO_HPP__
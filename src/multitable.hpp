@@ -0,0 +1,234 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __MULTITABLE_HPP__
+#define __MULTITABLE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "bitio.hpp"
+
+/**
+ * A lookup table to decode several codes at once.
+ *
+ * The table is indexed by the next `INDEX_BITS` bits of the stream. Each
+ * entry holds the tokens of all codes that are complete within these
+ * bits, concatenated into `MAX_BYTES` bytes, and the number of bits they
+ * take. As the most frequent tokens have the shortest codes, one lookup
+ * usually produces several tokens, which are written with a single store
+ * of `MAX_BYTES` bytes; the next store overwrites what lies beyond.
+ * Codes that don't fit into an entry are decoded with the tree the table
+ * was built from.
+ */
+template <typename TreeT>
+class multitable
+{
+public:
+    static constexpr unsigned int INDEX_BITS = 12;
+    static constexpr std::size_t MAX_BYTES = 8;
+    /**
+     * Longest code the fallback can decode; a refilled `bit_reader` holds at least 57 bits.
+     */
+    static constexpr unsigned long MAX_CODE_LENGTH = 56;
+
+    struct entry
+    {
+        char bytes[MAX_BYTES];
+        uint8_t length;
+        /**
+         * Bits consumed, 0 if the first code is longer than `INDEX_BITS`
+         * bits, invalid, or its token is longer than `MAX_BYTES` bytes.
+         */
+        uint8_t bits;
+        /**
+         * Whether the last code is that of the stop value, which isn't
+         * part of `bytes`.
+         */
+        bool stop;
+    };
+
+    /**
+     * Fill the table from `tree`, which must outlive it.
+     *
+     * @throw std::invalid_argument if a code is longer than `MAX_CODE_LENGTH` bits
+     */
+    void build(TreeT const &tree)
+    {
+        if (tree.max_code_length() > MAX_CODE_LENGTH)
+            throw std::invalid_argument("code too long for a multi-symbol table");
+        tree_ = &tree;
+        entries_.assign(std::size_t(1) << INDEX_BITS, entry{});
+        for (std::size_t i = 0; i < entries_.size(); ++i)
+        {
+            entry &e = entries_[i];
+            uint64_t window = uint64_t(i) << (64 - INDEX_BITS);
+            unsigned int left = INDEX_BITS;
+            while (left > 0)
+            {
+                unsigned int bits;
+                uint32_t leaf;
+                try
+                {
+                    leaf = tree.walk(window, left, bits);
+                }
+                catch (std::out_of_range const &)
+                {
+                    break; // left to the fallback, which reports the error
+                }
+                if (leaf == 0)
+                    break;
+                if (tree.is_stop(leaf))
+                {
+                    e.bits = static_cast<uint8_t>(e.bits + bits);
+                    e.stop = true;
+                    break;
+                }
+                const std::string_view token = tree.token(leaf);
+                if (e.length + token.size() > MAX_BYTES)
+                    break;
+                std::memcpy(e.bytes + e.length, token.data(), token.size());
+                e.length = static_cast<uint8_t>(e.length + token.size());
+                e.bits = static_cast<uint8_t>(e.bits + bits);
+                window <<= bits;
+                left -= bits;
+            }
+        }
+    }
+
+    /**
+     * Decode the `size` bytes at `in` into the `capacity` bytes at `out`
+     * up to the stop value. `ReaderT` is only replaced to compare bit readers.
+     *
+     * @return number of bytes written to `out`
+     * @throw std::length_error if the output doesn't fit into `out`
+     * @throw std::out_of_range if the bit stream contains an invalid code or ends before the stop value
+     */
+    template <typename ReaderT = txtz::bit_reader>
+    std::size_t decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const
+    {
+        ReaderT reader(in, size);
+        std::size_t pos = 0;
+        for (;;)
+        {
+            reader.refill();
+            if (reader.available() == 0)
+                throw std::out_of_range("compressed data truncated");
+            entry const &e = entries_[reader.window() >> (64 - INDEX_BITS)];
+            if (e.bits != 0 && e.bits <= reader.available() && e.length <= capacity - pos)
+            {
+                store(e, out + pos, capacity - pos);
+                pos += e.length;
+                reader.consume(e.bits);
+                if (e.stop)
+                    return pos;
+                continue;
+            }
+            unsigned int bits;
+            const uint32_t leaf = tree_->walk(reader.window(), reader.available(), bits);
+            if (leaf == 0)
+                throw std::out_of_range("compressed data truncated");
+            if (tree_->is_stop(leaf))
+                return pos;
+            const std::string_view token = tree_->token(leaf);
+            if (token.size() > capacity - pos)
+                throw std::length_error("output buffer too small");
+            std::memcpy(out + pos, token.data(), token.size());
+            pos += token.size();
+            reader.consume(bits);
+        }
+    }
+
+    /**
+     * Decode exactly `length` bytes of output from the `size` bytes at `in`.
+     *
+     * @throw std::out_of_range if the bit stream ends before `length` bytes were decoded
+     */
+    void decompress_exactly(uint8_t const *in, std::size_t size, char *out, std::size_t length) const
+    {
+        txtz::bit_reader reader(in, size);
+        std::size_t pos = 0;
+        while (pos < length)
+        {
+            reader.refill();
+            if (reader.available() == 0)
+                throw std::out_of_range("compressed data truncated");
+            entry const &e = entries_[reader.window() >> (64 - INDEX_BITS)];
+            // near the end, an entry may hold tokens decoded from the padding bits
+            if (e.bits != 0 && e.bits <= reader.available() && e.length <= length - pos)
+            {
+                store(e, out + pos, length - pos);
+                pos += e.length;
+                reader.consume(e.bits);
+                continue;
+            }
+            unsigned int bits;
+            const uint32_t leaf = tree_->walk(reader.window(), reader.available(), bits);
+            if (leaf == 0)
+                throw std::out_of_range("compressed data truncated");
+            const std::string_view token = tree_->token(leaf);
+            if (token.size() > length - pos)
+                throw std::out_of_range("compressed data exceeds announced length");
+            std::memcpy(out + pos, token.data(), token.size());
+            pos += token.size();
+            reader.consume(bits);
+        }
+    }
+
+    /**
+     * @return number of bytes occupied by the table
+     */
+    std::size_t memory_usage() const
+    {
+        return entries_.capacity() * sizeof(entry);
+    }
+
+private:
+    std::vector<entry> entries_;
+    TreeT const *tree_{nullptr};
+
+    /**
+     * Write the tokens of `e` with one fixed-size store if `room` allows.
+     */
+    static void store(entry const &e, char *out, std::size_t room)
+    {
+        if (room >= MAX_BYTES)
+        {
+            std::memcpy(out, e.bytes, MAX_BYTES);
+        }
+        else
+        {
+            std::memcpy(out, e.bytes, e.length);
+        }
+    }
+};
+
+#endif // __MULTITABLE_HPP__
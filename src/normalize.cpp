@@ -0,0 +1,350 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include "normalize.hpp"
+
+namespace txtz
+{
+    namespace normalize
+    {
+        namespace
+        {
+            /**
+             * Canonical compositions of an ASCII letter and a combining mark
+             * to a letter of the Latin-1 or Latin Extended-A block,
+             * sorted by letter and mark.
+             */
+            struct composition
+            {
+                char base;
+                uint16_t mark;
+                uint16_t composed;
+            };
+
+            constexpr composition COMPOSITIONS[] = {
+                {'A', 0x0300, 0x00C0}, {'A', 0x0301, 0x00C1}, {'A', 0x0302, 0x00C2}, {'A', 0x0303, 0x00C3},
+                {'A', 0x0304, 0x0100}, {'A', 0x0306, 0x0102}, {'A', 0x0308, 0x00C4}, {'A', 0x030A, 0x00C5},
+                {'A', 0x0328, 0x0104}, {'C', 0x0301, 0x0106}, {'C', 0x0302, 0x0108}, {'C', 0x0307, 0x010A},
+                {'C', 0x030C, 0x010C}, {'C', 0x0327, 0x00C7}, {'D', 0x030C, 0x010E}, {'E', 0x0300, 0x00C8},
+                {'E', 0x0301, 0x00C9}, {'E', 0x0302, 0x00CA}, {'E', 0x0304, 0x0112}, {'E', 0x0306, 0x0114},
+                {'E', 0x0307, 0x0116}, {'E', 0x0308, 0x00CB}, {'E', 0x030C, 0x011A}, {'E', 0x0328, 0x0118},
+                {'G', 0x0302, 0x011C}, {'G', 0x0306, 0x011E}, {'G', 0x0307, 0x0120}, {'G', 0x0327, 0x0122},
+                {'H', 0x0302, 0x0124}, {'I', 0x0300, 0x00CC}, {'I', 0x0301, 0x00CD}, {'I', 0x0302, 0x00CE},
+                {'I', 0x0303, 0x0128}, {'I', 0x0304, 0x012A}, {'I', 0x0306, 0x012C}, {'I', 0x0307, 0x0130},
+                {'I', 0x0308, 0x00CF}, {'I', 0x0328, 0x012E}, {'J', 0x0302, 0x0134}, {'K', 0x0327, 0x0136},
+                {'L', 0x0301, 0x0139}, {'L', 0x030C, 0x013D}, {'L', 0x0327, 0x013B}, {'N', 0x0301, 0x0143},
+                {'N', 0x0303, 0x00D1}, {'N', 0x030C, 0x0147}, {'N', 0x0327, 0x0145}, {'O', 0x0300, 0x00D2},
+                {'O', 0x0301, 0x00D3}, {'O', 0x0302, 0x00D4}, {'O', 0x0303, 0x00D5}, {'O', 0x0304, 0x014C},
+                {'O', 0x0306, 0x014E}, {'O', 0x0308, 0x00D6}, {'O', 0x030B, 0x0150}, {'R', 0x0301, 0x0154},
+                {'R', 0x030C, 0x0158}, {'R', 0x0327, 0x0156}, {'S', 0x0301, 0x015A}, {'S', 0x0302, 0x015C},
+                {'S', 0x030C, 0x0160}, {'S', 0x0327, 0x015E}, {'T', 0x030C, 0x0164}, {'T', 0x0327, 0x0162},
+                {'U', 0x0300, 0x00D9}, {'U', 0x0301, 0x00DA}, {'U', 0x0302, 0x00DB}, {'U', 0x0303, 0x0168},
+                {'U', 0x0304, 0x016A}, {'U', 0x0306, 0x016C}, {'U', 0x0308, 0x00DC}, {'U', 0x030A, 0x016E},
+                {'U', 0x030B, 0x0170}, {'U', 0x0328, 0x0172}, {'W', 0x0302, 0x0174}, {'Y', 0x0301, 0x00DD},
+                {'Y', 0x0302, 0x0176}, {'Y', 0x0308, 0x0178}, {'Z', 0x0301, 0x0179}, {'Z', 0x0307, 0x017B},
+                {'Z', 0x030C, 0x017D}, {'a', 0x0300, 0x00E0}, {'a', 0x0301, 0x00E1}, {'a', 0x0302, 0x00E2},
+                {'a', 0x0303, 0x00E3}, {'a', 0x0304, 0x0101}, {'a', 0x0306, 0x0103}, {'a', 0x0308, 0x00E4},
+                {'a', 0x030A, 0x00E5}, {'a', 0x0328, 0x0105}, {'c', 0x0301, 0x0107}, {'c', 0x0302, 0x0109},
+                {'c', 0x0307, 0x010B}, {'c', 0x030C, 0x010D}, {'c', 0x0327, 0x00E7}, {'d', 0x030C, 0x010F},
+                {'e', 0x0300, 0x00E8}, {'e', 0x0301, 0x00E9}, {'e', 0x0302, 0x00EA}, {'e', 0x0304, 0x0113},
+                {'e', 0x0306, 0x0115}, {'e', 0x0307, 0x0117}, {'e', 0x0308, 0x00EB}, {'e', 0x030C, 0x011B},
+                {'e', 0x0328, 0x0119}, {'g', 0x0302, 0x011D}, {'g', 0x0306, 0x011F}, {'g', 0x0307, 0x0121},
+                {'g', 0x0327, 0x0123}, {'h', 0x0302, 0x0125}, {'i', 0x0300, 0x00EC}, {'i', 0x0301, 0x00ED},
+                {'i', 0x0302, 0x00EE}, {'i', 0x0303, 0x0129}, {'i', 0x0304, 0x012B}, {'i', 0x0306, 0x012D},
+                {'i', 0x0308, 0x00EF}, {'i', 0x0328, 0x012F}, {'j', 0x0302, 0x0135}, {'k', 0x0327, 0x0137},
+                {'l', 0x0301, 0x013A}, {'l', 0x030C, 0x013E}, {'l', 0x0327, 0x013C}, {'n', 0x0301, 0x0144},
+                {'n', 0x0303, 0x00F1}, {'n', 0x030C, 0x0148}, {'n', 0x0327, 0x0146}, {'o', 0x0300, 0x00F2},
+                {'o', 0x0301, 0x00F3}, {'o', 0x0302, 0x00F4}, {'o', 0x0303, 0x00F5}, {'o', 0x0304, 0x014D},
+                {'o', 0x0306, 0x014F}, {'o', 0x0308, 0x00F6}, {'o', 0x030B, 0x0151}, {'r', 0x0301, 0x0155},
+                {'r', 0x030C, 0x0159}, {'r', 0x0327, 0x0157}, {'s', 0x0301, 0x015B}, {'s', 0x0302, 0x015D},
+                {'s', 0x030C, 0x0161}, {'s', 0x0327, 0x015F}, {'t', 0x030C, 0x0165}, {'t', 0x0327, 0x0163},
+                {'u', 0x0300, 0x00F9}, {'u', 0x0301, 0x00FA}, {'u', 0x0302, 0x00FB}, {'u', 0x0303, 0x0169},
+                {'u', 0x0304, 0x016B}, {'u', 0x0306, 0x016D}, {'u', 0x0308, 0x00FC}, {'u', 0x030A, 0x016F},
+                {'u', 0x030B, 0x0171}, {'u', 0x0328, 0x0173}, {'w', 0x0302, 0x0175}, {'y', 0x0301, 0x00FD},
+                {'y', 0x0302, 0x0177}, {'y', 0x0308, 0x00FF}, {'z', 0x0301, 0x017A}, {'z', 0x0307, 0x017C},
+                {'z', 0x030C, 0x017E},
+            };
+
+            constexpr uint32_t INVALID = 0xffffffffU;
+
+            /**
+             * Decode the code point starting at `it`. Only one- and two-byte
+             * sequences are decoded, everything else comes back as `INVALID`
+             * with a length of 1, so it is copied byte by byte.
+             */
+            uint32_t decode(char const *it, char const *last, std::size_t &length)
+            {
+                const auto b0 = static_cast<uint8_t>(it[0]);
+                length = 1;
+                if (b0 < 0x80)
+                    return b0;
+                if ((b0 & 0xe0) == 0xc0 && b0 >= 0xc2 && last - it >= 2)
+                {
+                    const auto b1 = static_cast<uint8_t>(it[1]);
+                    if ((b1 & 0xc0) == 0x80)
+                    {
+                        length = 2;
+                        return (uint32_t(b0 & 0x1f) << 6) | (b1 & 0x3f);
+                    }
+                }
+                return INVALID;
+            }
+
+            /**
+             * Append the one- or two-byte encoding of `cp`.
+             */
+            template <typename OutputIt>
+            OutputIt encode(uint32_t cp, OutputIt out)
+            {
+                if (cp < 0x80)
+                {
+                    *out++ = static_cast<char>(cp);
+                }
+                else
+                {
+                    *out++ = static_cast<char>(0xc0 | (cp >> 6));
+                    *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                return out;
+            }
+
+            bool is_combining_mark(uint32_t cp)
+            {
+                return cp >= 0x0300 && cp <= 0x036f;
+            }
+
+            uint32_t compose(uint32_t base, uint32_t mark)
+            {
+                if (base >= 0x80)
+                    return INVALID;
+                const composition key{static_cast<char>(base), static_cast<uint16_t>(mark), 0};
+                auto const *found = std::lower_bound(std::begin(COMPOSITIONS), std::end(COMPOSITIONS), key,
+                                                     [](composition const &a, composition const &b)
+                                                     { return a.base < b.base || (a.base == b.base && a.mark < b.mark); });
+                if (found == std::end(COMPOSITIONS) || found->base != key.base || found->mark != key.mark)
+                    return INVALID;
+                return found->composed;
+            }
+
+            /**
+             * Letters whose case mapping is a bijection between code points
+             * of equal UTF-8 length. İ, ı, ß, ĸ, ŉ and ſ don't qualify.
+             *
+             * @return the other case of `cp`, `INVALID` if `cp` has no case
+             */
+            uint32_t swap_case(uint32_t cp, bool &upper)
+            {
+                upper = false;
+                if (cp >= 'A' && cp <= 'Z')
+                {
+                    upper = true;
+                    return cp + 0x20;
+                }
+                if (cp >= 'a' && cp <= 'z')
+                    return cp - 0x20;
+                if (cp >= 0xc0 && cp <= 0xde && cp != 0xd7)
+                {
+                    upper = true;
+                    return cp + 0x20;
+                }
+                if (cp >= 0xe0 && cp <= 0xfe && cp != 0xf7)
+                    return cp - 0x20;
+                if (cp == 0xff)
+                    return 0x178;
+                if (cp == 0x178)
+                {
+                    upper = true;
+                    return 0xff;
+                }
+                if ((cp >= 0x100 && cp <= 0x12f) || (cp >= 0x132 && cp <= 0x137) || (cp >= 0x14a && cp <= 0x177))
+                {
+                    upper = (cp & 1) == 0;
+                    return cp ^ 1;
+                }
+                if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17e))
+                {
+                    upper = (cp & 1) == 1;
+                    return upper ? cp + 1 : cp - 1;
+                }
+                return INVALID;
+            }
+
+            bool is_marker(char c)
+            {
+                return c == CAPITAL || c == ALL_CAPITALS || c == ESCAPE;
+            }
+        }
+
+        void fold(char const *in, std::size_t size, std::string &out)
+        {
+            out.clear();
+            auto o = std::back_inserter(out);
+            char const *const last = in + size;
+            // decode the next code point, composing it with a following combining mark
+            auto next = [last](char const *&it) -> uint32_t
+            {
+                std::size_t length;
+                uint32_t cp = decode(it, last, length);
+                it += length;
+                if (cp != INVALID && it != last)
+                {
+                    const uint32_t mark = decode(it, last, length);
+                    if (is_combining_mark(mark))
+                    {
+                        const uint32_t composed = compose(cp, mark);
+                        if (composed != INVALID)
+                        {
+                            cp = composed;
+                            it += length;
+                        }
+                    }
+                }
+                return cp;
+            };
+            char const *it = in;
+            while (it != last)
+            {
+                char const *const word_begin = it;
+                uint32_t cp = next(it);
+                bool upper;
+                if (cp == INVALID || swap_case(cp, upper) == INVALID)
+                {
+                    if (cp == INVALID)
+                    {
+                        *o++ = it[-1];
+                    }
+                    else
+                    {
+                        if (cp < 0x80 && is_marker(static_cast<char>(cp)))
+                            *o++ = ESCAPE;
+                        o = encode(cp, o);
+                    }
+                    continue;
+                }
+                // first pass: find the end of the word and its case pattern
+                const bool first_upper = upper;
+                std::size_t letters = 1;
+                std::size_t uppers = upper ? 1 : 0;
+                char const *word_end = it;
+                while (word_end != last)
+                {
+                    char const *peek = word_end;
+                    cp = next(peek);
+                    if (cp == INVALID || swap_case(cp, upper) == INVALID)
+                        break;
+                    ++letters;
+                    uppers += upper ? 1 : 0;
+                    word_end = peek;
+                }
+                const bool mixed = uppers > 0 && !(uppers == letters && letters > 1) && !(uppers == 1 && first_upper);
+                if (!mixed && uppers > 0)
+                {
+                    *o++ = uppers == 1 ? CAPITAL : ALL_CAPITALS;
+                }
+                // second pass: write the word in lower case
+                for (it = word_begin; it != word_end;)
+                {
+                    cp = next(it);
+                    const uint32_t other = swap_case(cp, upper);
+                    if (upper)
+                    {
+                        if (mixed)
+                            *o++ = CAPITAL;
+                        cp = other;
+                    }
+                    o = encode(cp, o);
+                }
+            }
+        }
+
+        std::size_t unfold(char const *in, std::size_t size, char *out, std::size_t capacity)
+        {
+            char const *it = in;
+            char const *const last = in + size;
+            std::size_t pos = 0;
+            bool all_capitals = false;
+            auto put = [&](char const *first, std::size_t length)
+            {
+                if (length > capacity - pos)
+                    throw std::length_error("output buffer too small");
+                // `out` may be `in`, the output never overtakes the input
+                std::memmove(out + pos, first, length);
+                pos += length;
+            };
+            while (it != last)
+            {
+                const char c = *it;
+                if (c == ESCAPE)
+                {
+                    if (last - it < 2)
+                        throw std::out_of_range("escape at end of input");
+                    put(it + 1, 1);
+                    it += 2;
+                    all_capitals = false;
+                    continue;
+                }
+                bool capital = false;
+                if (c == CAPITAL || c == ALL_CAPITALS)
+                {
+                    capital = true;
+                    all_capitals = c == ALL_CAPITALS;
+                    if (++it == last)
+                        throw std::out_of_range("capitalization marker at end of input");
+                }
+                std::size_t length;
+                const uint32_t cp = decode(it, last, length);
+                bool upper;
+                const uint32_t other = cp == INVALID ? INVALID : swap_case(cp, upper);
+                if (other == INVALID)
+                {
+                    if (capital)
+                        throw std::out_of_range("capitalization marker not followed by a letter");
+                    all_capitals = false;
+                    put(it, length);
+                }
+                else if ((capital || all_capitals) && !upper)
+                {
+                    char buffer[2];
+                    const std::size_t n = static_cast<std::size_t>(encode(other, buffer) - buffer);
+                    put(buffer, n);
+                }
+                else
+                {
+                    put(it, length);
+                }
+                it += length;
+            }
+            return pos;
+        }
+    }
+}
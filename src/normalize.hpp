@@ -0,0 +1,77 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __NORMALIZE_HPP__
+#define __NORMALIZE_HPP__
+
+#include <cstddef>
+#include <string>
+
+namespace txtz
+{
+    /**
+     * A transform in front of the tokenizer, so that the dictionary can be
+     * trained on case-folded text.
+     *
+     * `fold()` composes decomposed Latin letters (NFC) and lowercases all
+     * letters of the Latin-1 and Latin Extended-A blocks. Capitalization is
+     * kept as markers in front of the folded word:
+     *
+     *  - `CAPITAL` uppercases the next letter,
+     *  - `ALL_CAPITALS` uppercases all letters up to the end of the word,
+     *  - `ESCAPE` makes the next byte a literal, so that input containing
+     *    one of the marker bytes survives the round trip.
+     *
+     * A word is a maximal run of letters that have an upper and a lower
+     * case form. `unfold()` restores the original text, except that
+     * decomposed letters come back composed.
+     */
+    namespace normalize
+    {
+        constexpr char CAPITAL = '\x0e';
+        constexpr char ALL_CAPITALS = '\x0f';
+        constexpr char ESCAPE = '\x10';
+
+        /**
+         * Fold the `size` bytes at `in` into `out`, replacing its contents.
+         * The result is at most twice as long as the input.
+         */
+        void fold(char const *in, std::size_t size, std::string &out);
+
+        /**
+         * Undo `fold()`, writing to the `capacity` bytes at `out`.
+         * The output is never longer than the input, so `out` may be `in`.
+         *
+         * @return number of bytes written to `out`
+         * @throw std::length_error if `out` is too small
+         * @throw std::out_of_range if a marker isn't followed by what it applies to
+         */
+        std::size_t unfold(char const *in, std::size_t size, char *out, std::size_t capacity);
+    }
+}
+
+#endif // __NORMALIZE_HPP__
@@ -0,0 +1,318 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __PIPELINE_HPP__
+#define __PIPELINE_HPP__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace txtz
+{
+    /**
+     * An ordered three-stage pipeline: a reader thread produces blocks,
+     * a pool of workers transforms them, and the calling thread consumes
+     * the results in the order the blocks were read.
+     *
+     * No more than `max_in_flight` blocks are read but not yet written at
+     * any time, so memory usage is bounded regardless of the input size.
+     */
+    class pipeline final
+    {
+    public:
+        using block = std::vector<char>;
+        /**
+         * Fill the block with the next chunk of input; return false at end of input.
+         */
+        using reader = std::function<bool(block &)>;
+        /**
+         * Transform an input block into an output block. The first argument
+         * is the index of the worker, e.g. to pick per-thread scratch data.
+         */
+        using worker = std::function<void(unsigned int, block const &, block &)>;
+        using writer = std::function<void(block const &)>;
+
+        pipeline(unsigned int num_workers, std::size_t max_in_flight)
+            : num_workers_(std::max(1U, num_workers)), max_in_flight_(std::max(std::size_t(1), max_in_flight)) {}
+
+        /**
+         * @return a reader that cuts `in` into blocks of at most `block_size`
+         * bytes, each ending after the last line break it contains, if any
+         *
+         * If `max_line_size` isn't 0, blocks only end at a line break or at
+         * the end of input: a block without line break grows until it has
+         * one, so that no line is cut in two.
+         * @throw std::length_error if a line is longer than `max_line_size` bytes
+         */
+        static reader line_reader(std::istream &in, std::size_t block_size, std::size_t max_line_size = 0)
+        {
+            auto carry = std::make_shared<block>();
+            auto lines = std::make_shared<std::size_t>(0);
+            return [&in, carry, lines, block_size, max_line_size](block &b) -> bool
+            {
+                b.swap(*carry);
+                carry->clear();
+                // bytes at the start of `b` known to hold no line break
+                std::size_t searched = 0;
+                for (;;)
+                {
+                    const std::size_t have = b.size();
+                    const std::size_t want = searched + block_size;
+                    if (have < want)
+                    {
+                        b.resize(want);
+                        in.read(b.data() + have, static_cast<std::streamsize>(want - have));
+                        b.resize(have + static_cast<std::size_t>(in.gcount()));
+                    }
+                    if (b.empty())
+                        return false;
+                    if (searched == 0)
+                    {
+                        if (!in)
+                            return true;
+                        auto const nl = std::find(b.rbegin(), b.rend(), '\n');
+                        if (nl != b.rend())
+                        {
+                            carry->assign(nl.base(), std::end(b));
+                            b.erase(nl.base(), std::end(b));
+                            if (max_line_size != 0)
+                            {
+                                *lines += static_cast<std::size_t>(std::count(std::begin(b), std::end(b), '\n'));
+                            }
+                            return true;
+                        }
+                        if (max_line_size == 0)
+                            return true;
+                    }
+                    else
+                    {
+                        // the block holds a single line, which ends at the first line break read since
+                        auto const nl = std::find(std::begin(b) + static_cast<std::ptrdiff_t>(searched), std::end(b), '\n');
+                        if (nl != std::end(b))
+                        {
+                            if (static_cast<std::size_t>(nl - std::begin(b)) > max_line_size)
+                                break;
+                            carry->assign(nl + 1, std::end(b));
+                            b.erase(nl + 1, std::end(b));
+                            ++*lines;
+                            return true;
+                        }
+                        if (!in && b.size() <= max_line_size)
+                            return true;
+                    }
+                    if (b.size() > max_line_size)
+                        break;
+                    searched = b.size();
+                }
+                throw std::length_error("line " + std::to_string(*lines + 1) + " is longer than " + std::to_string(max_line_size) + " bytes");
+            };
+        }
+
+        /**
+         * @return a reader that cuts the `size` bytes at `data`, e.g. a
+         * `mapped_file`, into blocks like `line_reader()` does
+         */
+        static reader memory_reader(char const *data, std::size_t size, std::size_t block_size)
+        {
+            auto pos = std::make_shared<std::size_t>(0);
+            return [data, size, pos, block_size](block &b) -> bool
+            {
+                if (*pos == size)
+                    return false;
+                char const *first = data + *pos;
+                char const *last = data + std::min(size, *pos + block_size);
+                if (last != data + size)
+                {
+                    auto const nl = std::find(std::make_reverse_iterator(last), std::make_reverse_iterator(first), '\n');
+                    if (nl != std::make_reverse_iterator(first))
+                    {
+                        last = nl.base();
+                    }
+                }
+                b.assign(first, last);
+                *pos += static_cast<std::size_t>(last - first);
+                return true;
+            };
+        }
+
+        /**
+         * Run the pipeline until all input has been written.
+         *
+         * @throw whatever the first failing stage threw
+         */
+        void run(reader read, worker process, writer write)
+        {
+            std::thread reader_thread([this, &read]
+                                      { read_loop(read); });
+            std::vector<std::thread> workers;
+            for (unsigned int i = 0; i < num_workers_; ++i)
+            {
+                workers.emplace_back([this, i, &process]
+                                     { work_loop(i, process); });
+            }
+            try
+            {
+                write_loop(write);
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+            reader_thread.join();
+            for (auto &w : workers)
+            {
+                w.join();
+            }
+            if (error_)
+                std::rethrow_exception(error_);
+        }
+
+    private:
+        unsigned int num_workers_;
+        std::size_t max_in_flight_;
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<std::pair<std::size_t, block>> input_;
+        std::map<std::size_t, block> output_;
+        std::size_t in_flight_{0};
+        std::size_t blocks_read_{0};
+        bool end_of_input_{false};
+        std::exception_ptr error_;
+
+        void fail(std::exception_ptr e)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!error_)
+            {
+                error_ = e;
+            }
+            cv_.notify_all();
+        }
+
+        void read_loop(reader &read)
+        {
+            try
+            {
+                for (;;)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(mtx_);
+                        cv_.wait(lock, [this]
+                                 { return error_ || in_flight_ < max_in_flight_; });
+                        if (error_)
+                            return;
+                    }
+                    block b;
+                    const bool more = read(b);
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    if (more)
+                    {
+                        input_.emplace_back(blocks_read_++, std::move(b));
+                        ++in_flight_;
+                    }
+                    else
+                    {
+                        end_of_input_ = true;
+                    }
+                    cv_.notify_all();
+                    if (!more)
+                        return;
+                }
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        }
+
+        void work_loop(unsigned int worker_index, worker &process)
+        {
+            try
+            {
+                for (;;)
+                {
+                    std::pair<std::size_t, block> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mtx_);
+                        cv_.wait(lock, [this]
+                                 { return error_ || !input_.empty() || end_of_input_; });
+                        if (error_ || input_.empty())
+                            return;
+                        job = std::move(input_.front());
+                        input_.pop_front();
+                    }
+                    block result;
+                    process(worker_index, job.second, result);
+                    std::lock_guard<std::mutex> lock(mtx_);
+                    output_.emplace(job.first, std::move(result));
+                    cv_.notify_all();
+                }
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        }
+
+        void write_loop(writer &write)
+        {
+            for (std::size_t next = 0;; ++next)
+            {
+                block b;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    cv_.wait(lock, [this, next]
+                             { return error_ || output_.count(next) != 0 || (end_of_input_ && next == blocks_read_); });
+                    if (error_ || output_.count(next) == 0)
+                        return;
+                    b = std::move(output_[next]);
+                    output_.erase(next);
+                }
+                write(b);
+                std::lock_guard<std::mutex> lock(mtx_);
+                --in_flight_;
+                cv_.notify_all();
+            }
+        }
+    };
+}
+
+#endif // __PIPELINE_HPP__
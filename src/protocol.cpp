@@ -0,0 +1,144 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+#include "util.hpp"
+
+namespace txtz
+{
+    namespace protocol
+    {
+        void append_frame(std::vector<uint8_t> &out, uint8_t type, uint8_t const *payload, std::size_t size)
+        {
+            out.push_back(type);
+            util::append_varint(out, size);
+            out.insert(std::end(out), payload, payload + size);
+        }
+
+        std::size_t parse_frame(uint8_t const *data, std::size_t size, uint8_t &type, std::size_t &payload_offset, std::size_t &payload_size)
+        {
+            if (size < 2)
+                return 0;
+            type = data[0];
+            const std::size_t header_size = util::read_varint(data + 1, size - 1, payload_size);
+            if (header_size == 0)
+            {
+                if (size - 1 > 10)
+                    throw std::length_error("malformed frame header");
+                return 0;
+            }
+            if (payload_size > MAX_PAYLOAD_SIZE)
+                throw std::length_error("frame payload too large");
+            payload_offset = 1 + header_size;
+            if (size - payload_offset < payload_size)
+                return 0;
+            return payload_offset + payload_size;
+        }
+
+        bool send_all(int fd, uint8_t const *data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                const ssize_t n = ::send(fd, data, size, 0);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                size -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        namespace
+        {
+            bool receive_all(int fd, uint8_t *data, std::size_t size)
+            {
+                while (size > 0)
+                {
+                    const ssize_t n = ::recv(fd, data, size, 0);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+                    data += n;
+                    size -= static_cast<std::size_t>(n);
+                }
+                return true;
+            }
+        }
+
+        bool receive_frame(int fd, uint8_t &type, std::vector<uint8_t> &payload)
+        {
+            if (!receive_all(fd, &type, 1))
+                return false;
+            std::size_t size = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                uint8_t byte;
+                if (shift >= 64 || !receive_all(fd, &byte, 1))
+                    return false;
+                size |= static_cast<std::size_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                    break;
+            }
+            if (size > MAX_PAYLOAD_SIZE)
+                return false;
+            payload.resize(size);
+            return receive_all(fd, payload.data(), size);
+        }
+
+        int connect(std::string const &path)
+        {
+            sockaddr_un addr{};
+            if (path.size() >= sizeof(addr.sun_path))
+                throw std::runtime_error("socket path too long: " + path);
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+            const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0)
+                throw std::runtime_error(std::string("cannot create socket: ") + std::strerror(errno));
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+            {
+                const int err = errno;
+                ::close(fd);
+                throw std::runtime_error("cannot connect to " + path + ": " + std::strerror(err));
+            }
+            return fd;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __PROTOCOL_HPP__
+#define __PROTOCOL_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace txtz
+{
+    /**
+     * Wire format spoken between `txtzd` and its clients over a Unix domain socket.
+     *
+     * Every request and every response is a frame:
+     *
+     *     type (1 byte) | payload length (LEB128 varint) | payload
+     *
+     * For requests the type is an `op_t`, for responses a `status_t`.
+     * A client may send any number of requests without waiting;
+     * responses arrive in the order the requests were sent.
+     */
+    namespace protocol
+    {
+        enum op_t : uint8_t
+        {
+            /** payload: uncompressed string; response: compressed data */
+            COMPRESS = 1,
+            /** payload: compressed data; response: uncompressed string */
+            DECOMPRESS = 2,
+            /** no payload; response: human readable counters and latency histogram */
+            STATS = 3,
+        };
+
+        enum status_t : uint8_t
+        {
+            OK = 0,
+            /** payload: error message */
+            ERROR = 1,
+        };
+
+        /**
+         * Frames with larger payloads are rejected.
+         */
+        constexpr std::size_t MAX_PAYLOAD_SIZE = 16U << 20;
+
+        void append_frame(std::vector<uint8_t> &out, uint8_t type, uint8_t const *payload, std::size_t size);
+
+        /**
+         * Look for a complete frame in the `size` bytes at `data`.
+         *
+         * @return number of bytes the frame occupies, 0 if more data is needed
+         * @throw std::length_error if the announced payload exceeds `MAX_PAYLOAD_SIZE`
+         */
+        std::size_t parse_frame(uint8_t const *data, std::size_t size, uint8_t &type, std::size_t &payload_offset, std::size_t &payload_size);
+
+        /**
+         * Write all `size` bytes to `fd`, retrying on partial writes.
+         *
+         * @return false if the peer went away
+         */
+        bool send_all(int fd, uint8_t const *data, std::size_t size);
+
+        /**
+         * Blocking read of one frame from `fd`.
+         *
+         * @return false on end of stream or error
+         */
+        bool receive_frame(int fd, uint8_t &type, std::vector<uint8_t> &payload);
+
+        /**
+         * Connect to the Unix domain socket at `path`.
+         *
+         * @throw std::runtime_error if the connection cannot be established
+         */
+        int connect(std::string const &path);
+    }
+}
+
+#endif // __PROTOCOL_HPP__
@@ -0,0 +1,181 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "record.hpp"
+#include "util.hpp"
+
+namespace txtz
+{
+    record_codec::record_codec(std::vector<std::unordered_map<std::string, code>> const &tables,
+                               char separator,
+                               txtz::normalization_t normalization)
+        : separator_(separator)
+    {
+        if (tables.empty())
+            throw std::invalid_argument("a record needs at least one field");
+        codecs_.reserve(tables.size());
+        for (auto const &table : tables)
+        {
+            codecs_.emplace_back(table, normalization);
+        }
+    }
+
+    std::size_t record_codec::max_token_length() const
+    {
+        std::size_t length = 0;
+        for (auto const &z : codecs_)
+        {
+            length = std::max(length, z.max_token_length());
+        }
+        return length;
+    }
+
+    std::size_t record_codec::compress_bound(std::size_t size) const
+    {
+        // every field may be as long as the whole record
+        std::size_t bound = 0;
+        for (auto const &z : codecs_)
+        {
+            const std::size_t field_bound = z.compress_bound(size);
+            bound += util::varint_size(field_bound) + field_bound;
+        }
+        return bound;
+    }
+
+    std::size_t record_codec::compress(std::string_view record, uint8_t *out, std::size_t capacity, std::size_t &bits) const
+    {
+        char const *in = record.data();
+        const std::size_t size = record.size();
+        if (static_cast<std::size_t>(std::count(in, in + size, separator_)) + 1 != codecs_.size())
+            throw std::invalid_argument("record doesn't have " + std::to_string(codecs_.size()) + " fields");
+        std::size_t pos = 0;
+        bits = 0;
+        char const *const last = in + size;
+        for (std::size_t i = 0; i < codecs_.size(); ++i)
+        {
+            char const *const field_end = std::find(in, last, separator_);
+            const std::size_t field_size = static_cast<std::size_t>(field_end - in);
+            std::size_t field_bits;
+            if (i + 1 == codecs_.size())
+            {
+                pos += codecs_[i].compress(std::string_view(in, field_size), out + pos, capacity - pos, field_bits);
+                bits += field_bits;
+                break;
+            }
+            // leave room for the largest possible size header, then move the data if it's smaller
+            const std::size_t max_header_size = util::varint_size(codecs_[i].compress_bound(field_size));
+            if (max_header_size > capacity - pos)
+                throw std::length_error("output buffer too small");
+            const std::size_t compressed_size = codecs_[i].compress(std::string_view(in, field_size), out + pos + max_header_size, capacity - pos - max_header_size, field_bits);
+            const std::size_t header_size = util::write_varint(out + pos, max_header_size, compressed_size);
+            if (header_size < max_header_size)
+            {
+                std::memmove(out + pos + header_size, out + pos + max_header_size, compressed_size);
+            }
+            pos += header_size + compressed_size;
+            bits += 8 * header_size + field_bits;
+            in = field_end + 1;
+        }
+        return pos;
+    }
+
+    std::size_t record_codec::compressed_bits(std::string_view record) const
+    {
+        if (static_cast<std::size_t>(std::count(std::begin(record), std::end(record), separator_)) + 1 != codecs_.size())
+            throw std::invalid_argument("record doesn't have " + std::to_string(codecs_.size()) + " fields");
+        std::size_t bits = 0;
+        for (std::size_t i = 0; i < codecs_.size(); ++i)
+        {
+            const std::size_t field_end = std::min(record.find(separator_), record.size());
+            const std::size_t field_bits = codecs_[i].compressed_bits(record.substr(0, field_end));
+            bits += field_bits;
+            if (i + 1 < codecs_.size())
+            {
+                // the size header in front of all but the last field
+                bits += 8 * util::varint_size((field_bits + 7) / 8);
+                record.remove_prefix(field_end + 1);
+            }
+        }
+        return bits;
+    }
+
+    void record_codec::next_field(uint8_t const *&in, std::size_t &size, std::size_t field,
+                                  uint8_t const *&field_in, std::size_t &field_size) const
+    {
+        field_in = in;
+        if (field + 1 == codecs_.size())
+        {
+            // the last field takes the rest
+            field_size = size;
+            in += size;
+            size = 0;
+            return;
+        }
+        const std::size_t header_size = util::read_varint(in, size, field_size);
+        if (header_size == 0 || field_size > size - header_size)
+            throw std::out_of_range("invalid field size");
+        field_in = in + header_size;
+        in += header_size + field_size;
+        size -= header_size + field_size;
+    }
+
+    std::size_t record_codec::decompress_field(uint8_t const *in, std::size_t size, std::size_t field, char *out, std::size_t capacity) const
+    {
+        if (field >= codecs_.size())
+            throw std::out_of_range("no such field");
+        uint8_t const *field_in;
+        std::size_t field_size;
+        for (std::size_t i = 0; i <= field; ++i)
+        {
+            next_field(in, size, i, field_in, field_size);
+        }
+        return codecs_[field].decompress(field_in, field_size, out, capacity);
+    }
+
+    std::size_t record_codec::decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const
+    {
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i < codecs_.size(); ++i)
+        {
+            if (i > 0)
+            {
+                if (pos == capacity)
+                    throw std::length_error("output buffer too small");
+                out[pos++] = separator_;
+            }
+            uint8_t const *field_in;
+            std::size_t field_size;
+            next_field(in, size, i, field_in, field_size);
+            pos += codecs_[i].decompress(field_in, field_size, out + pos, capacity - pos);
+        }
+        return pos;
+    }
+}
@@ -0,0 +1,133 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __RECORD_HPP__
+#define __RECORD_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "code.hpp"
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * Compresses records of separated fields, e.g. "first,last",
+     * each field with a dictionary of its own.
+     *
+     * The separator isn't encoded. A compressed record consists of the
+     * compressed fields, each but the last one preceded by its size in
+     * bytes (LEB128 varint):
+     *
+     *     size 0 | field 0 | size 1 | field 1 | ... | field n-1
+     *
+     * so that a single field can be decoded without decoding the others.
+     */
+    class record_codec final
+    {
+    public:
+        /**
+         * @param tables one code table per field
+         * @throw std::invalid_argument if `tables` is empty
+         */
+        record_codec(std::vector<std::unordered_map<std::string, code>> const &tables,
+                     char separator = ',',
+                     txtz::normalization_t normalization = txtz::normalization_t::none);
+
+        std::size_t fields() const
+        {
+            return codecs_.size();
+        }
+
+        char separator() const
+        {
+            return separator_;
+        }
+
+        /**
+         * @return length of the longest token in any of the field dictionaries
+         */
+        std::size_t max_token_length() const;
+
+        /**
+         * Compress `record` into the `capacity` bytes at `out`.
+         *
+         * @param bits receives the number of bits written, including size headers
+         * @return number of bytes written to `out`
+         * @throw std::invalid_argument if the record doesn't have `fields()` fields
+         * @throw std::length_error if `out` is too small, see `compress_bound()`
+         */
+        std::size_t compress(std::string_view record, uint8_t *out, std::size_t capacity, std::size_t &bits) const;
+
+        /**
+         * @return number of bytes sufficient to hold a compressed record of `size` bytes
+         */
+        std::size_t compress_bound(std::size_t size) const;
+
+        /**
+         * Number of bits `compress()` would report for `record`, see `txtz::compressed_bits()`.
+         *
+         * @throw std::invalid_argument if the record doesn't have `fields()` fields
+         */
+        std::size_t compressed_bits(std::string_view record) const;
+
+        /**
+         * Decompress a whole record, joining its fields with the separator.
+         *
+         * @return number of bytes written to `out`
+         * @throw std::length_error if `out` is too small
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        std::size_t decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const;
+
+        /**
+         * Decompress field number `field` only; the fields before it are skipped by their size.
+         *
+         * @throw std::out_of_range if `field` is out of range or the compressed data is corrupt
+         */
+        std::size_t decompress_field(uint8_t const *in, std::size_t size, std::size_t field, char *out, std::size_t capacity) const;
+
+    private:
+        std::vector<txtz> codecs_;
+        char separator_;
+
+        /**
+         * Split off the compressed bytes of field number `field` from the front of `in`.
+         *
+         * @throw std::out_of_range if the size header is invalid
+         */
+        void next_field(uint8_t const *&in, std::size_t &size, std::size_t field,
+                        uint8_t const *&field_in, std::size_t &field_size) const;
+    };
+}
+
+#endif // __RECORD_HPP__
@@ -28,49 +28,118 @@
 #include "shannon-fano.hpp"
 
 #include <algorithm>
+#include <cstddef>
+#include <future>
+#include <stdexcept>
+#include <thread>
 
 namespace txtz
 {
-    void shannon_fano(std::vector<ngram_t> &p, std::size_t l, std::size_t r, code c)
+    namespace
     {
-        if (l == r)
-        {
-            p[l].c = c;
-            return;
-        }
-        std::size_t pl = l;
-        std::size_t pr = r;
-        auto wl = p.at(pl).weight;
-        auto wr = p.at(pr).weight;
-        for (;;)
+        /**
+         * Subranges with fewer n-grams than this are never handed to another thread.
+         */
+        constexpr std::size_t PARALLEL_THRESHOLD = 1U << 15;
+
+        struct shannon_fano_builder
         {
-            while (wr < wl && pr != pl + 1)
+            std::vector<ngram_t> &p;
+            /**
+             * sum[i] is the total weight of p[0] .. p[i-1].
+             */
+            std::vector<double> sum;
+
+            explicit shannon_fano_builder(std::vector<ngram_t> &p)
+                : p(p), sum(p.size() + 1)
             {
-                --pr;
-                wr += p.at(pr).weight;
+                sum[0] = 0;
+                for (std::size_t i = 0; i < p.size(); ++i)
+                {
+                    sum[i + 1] = sum[i] + double(p[i].weight);
+                }
             }
-            if (pr != pl + 1)
+
+            /**
+             * Find the last index of the left part of [l, r].
+             *
+             * The split is the one a two-pointer scan finds when it grows the
+             * right part while its weight is less than that of the left part,
+             * and the left part otherwise, until both meet. That scan is a merge
+             * of the ascending sequences of left sums A(i) = w[l..l+i] and right
+             * sums B(j) = w[r-j..r], so the number of left steps after k = r-l-1
+             * steps is the smallest i with i == k or B(k-i-1) < A(i).
+             */
+            std::size_t split(std::size_t l, std::size_t r) const
             {
-                ++pl;
-                wl += p.at(pl).weight;
+                const std::size_t k = r - l - 1;
+                std::size_t lo = 0;
+                std::size_t hi = k;
+                while (lo < hi)
+                {
+                    const std::size_t i = lo + (hi - lo) / 2;
+                    const double a = sum[l + i + 1] - sum[l];
+                    const double b = sum[r + 1] - sum[r - (k - i - 1)];
+                    if (b < a)
+                    {
+                        hi = i;
+                    }
+                    else
+                    {
+                        lo = i + 1;
+                    }
+                }
+                return l + lo;
             }
-            else
+
+            void build(std::size_t l, std::size_t r, code c, unsigned int parallel_depth)
             {
-                break;
+                while (l != r)
+                {
+                    if (c.bitcount() == 8 * sizeof(code_t))
+                        throw std::length_error("Shannon-Fano code exceeds maximum code length");
+                    const std::size_t pl = split(l, r);
+                    if (parallel_depth > 0 && pl - l >= PARALLEL_THRESHOLD && r - pl >= PARALLEL_THRESHOLD)
+                    {
+                        auto left = std::async(std::launch::async, &shannon_fano_builder::build, this, l, pl, c + 0, parallel_depth - 1);
+                        build(pl + 1, r, c + 1, parallel_depth - 1);
+                        left.get();
+                        return;
+                    }
+                    // recurse into the smaller part, iterate on the larger one
+                    if (pl - l < r - pl - 1)
+                    {
+                        build(l, pl, c + 0, parallel_depth);
+                        l = pl + 1;
+                        c = c + 1;
+                    }
+                    else
+                    {
+                        build(pl + 1, r, c + 1, parallel_depth);
+                        r = pl;
+                        c = c + 0;
+                    }
+                }
+                p[l].c = c;
             }
-        }
-        shannon_fano(p, l, pl, c + 0);
-        shannon_fano(p, pr, r, c + 1);
+        };
     }
 
     void shannon_fano(std::vector<ngram_t> &p, bool do_sort)
     {
+        if (p.empty())
+            return;
         if (do_sort)
         {
             std::sort(std::begin(p), std::end(p), [](ngram_t const &a, ngram_t const &b)
                       { return a.weight > b.weight; });
         }
-        shannon_fano(p, 0U, p.size() - 1U, code());
+        unsigned int parallel_depth = 0;
+        for (unsigned int threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2)
+        {
+            ++parallel_depth;
+        }
+        shannon_fano_builder(p).build(0U, p.size() - 1U, code(), parallel_depth);
     }
 
 }
@@ -40,7 +40,11 @@ namespace txtz
      * Update `txtz::code` field of each n-gram to reflect
      * the path to the corresponding node in the binary tree.
      *
-     * @param p sorted list of n-grams
+     * Split points are found by binary search on prefix sums of the
+     * weights; large subtrees are built on separate threads.
+     *
+     * @param p list of n-grams, sorted by descending weight unless `do_sort` is true
+     * @throw std::length_error if a code would exceed the width of `code_t`
      */
     void shannon_fano(std::vector<ngram_t> &, bool do_sort = true);
 
@@ -0,0 +1,167 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __SPACESAVING_HPP__
+#define __SPACESAVING_HPP__
+
+#include <cstddef>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace txtz
+{
+    /**
+     * Finds the heaviest tokens of a stream of weighted tokens in a single
+     * pass with a bounded number of counters (Space-Saving algorithm by
+     * Metwally, Agrawal and El Abbadi).
+     *
+     * While there are free counters, every token gets one. Once all are
+     * taken, a new token replaces the one with the lowest weight and takes
+     * over its weight as possible error. So the weight of a counter is at
+     * least the true weight of its token and overestimates it by no more
+     * than its `error`, which never exceeds the lowest weight of all
+     * counters, and thus the total weight divided by `capacity`. Every
+     * token weighing more than that is guaranteed to have a counter.
+     */
+    class space_saving final
+    {
+    public:
+        struct counter
+        {
+            float weight;
+            float error;
+        };
+
+        /**
+         * @throw std::invalid_argument if `capacity` is 0
+         */
+        explicit space_saving(std::size_t capacity)
+            : capacity_(capacity)
+        {
+            if (capacity_ == 0)
+                throw std::invalid_argument("space_saving needs at least one counter");
+            counters_.reserve(capacity_);
+        }
+
+        void add(std::string const &token, float weight)
+        {
+            total_weight_ += weight;
+            auto it = counters_.find(token);
+            if (it != std::end(counters_))
+            {
+                it->second.c.weight += weight;
+                reposition(it->second, it->first);
+                return;
+            }
+            counter c{weight, 0};
+            if (counters_.size() == capacity_)
+            {
+                auto lightest = std::begin(by_weight_);
+                c.weight += lightest->first;
+                c.error = lightest->first;
+                counters_.erase(counters_.find(*lightest->second));
+                by_weight_.erase(lightest);
+            }
+            it = counters_.emplace(token, entry{c, {}}).first;
+            it->second.pos = by_weight_.emplace(c.weight, &it->first);
+        }
+
+        std::size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        std::size_t size() const
+        {
+            return counters_.size();
+        }
+
+        float total_weight() const
+        {
+            return total_weight_;
+        }
+
+        /**
+         * @return highest possible overestimation of any weight, which is
+         * also the weight above which no token can have been missed
+         */
+        float max_error() const
+        {
+            return counters_.size() < capacity_ ? 0.f : std::begin(by_weight_)->first;
+        }
+
+        /**
+         * @return the tokens with a counter and their estimated weights
+         */
+        std::unordered_map<std::string, float> weights() const
+        {
+            std::unordered_map<std::string, float> result;
+            result.reserve(counters_.size());
+            for (auto const &[token, e] : counters_)
+            {
+                result.emplace(token, e.c.weight);
+            }
+            return result;
+        }
+
+        /**
+         * @return the counter of `token`, or a zero weight if it has none
+         */
+        counter at(std::string const &token) const
+        {
+            auto it = counters_.find(token);
+            return it == std::end(counters_) ? counter{0, 0} : it->second.c;
+        }
+
+    private:
+        /**
+         * Counters ordered by weight, lightest first, referring to the keys of `counters_`.
+         */
+        using order = std::multimap<float, std::string const *>;
+
+        struct entry
+        {
+            counter c;
+            order::iterator pos;
+        };
+
+        std::size_t capacity_;
+        float total_weight_{0};
+        std::unordered_map<std::string, entry> counters_;
+        order by_weight_;
+
+        void reposition(entry &e, std::string const &token)
+        {
+            by_weight_.erase(e.pos);
+            e.pos = by_weight_.emplace(e.c.weight, &token);
+        }
+    };
+}
+
+#endif // __SPACESAVING_HPP__
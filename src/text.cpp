@@ -0,0 +1,577 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TXTZ_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "text.hpp"
+
+namespace txtz
+{
+    namespace text
+    {
+        namespace
+        {
+            constexpr char BASE64_DIGITS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            constexpr char BASE85_DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ.-:+=^!/*?&<>()[]{}@%$#";
+            static_assert(sizeof(BASE64_DIGITS) == 65 && sizeof(BASE85_DIGITS) == 86, "incomplete alphabet");
+            constexpr char PADDING = '=';
+            constexpr uint8_t INVALID = 0xff;
+
+            /**
+             * Value of every character in both alphabets, `INVALID` for characters not in them.
+             */
+            struct digit_values
+            {
+                uint8_t base64[256];
+                uint8_t base85[256];
+
+                digit_values()
+                {
+                    std::fill(std::begin(base64), std::end(base64), INVALID);
+                    std::fill(std::begin(base85), std::end(base85), INVALID);
+                    for (uint8_t i = 0; i < 64; ++i)
+                    {
+                        base64[static_cast<unsigned char>(BASE64_DIGITS[i])] = i;
+                    }
+                    for (uint8_t i = 0; i < 85; ++i)
+                    {
+                        base85[static_cast<unsigned char>(BASE85_DIGITS[i])] = i;
+                    }
+                }
+            };
+
+            const digit_values values;
+
+            /**
+             * Holds compressed data on its way to or from text.
+             */
+            thread_local std::vector<uint8_t> binary_buffer;
+
+            std::size_t base64_encode_scalar(uint8_t const *in, std::size_t size, char *out)
+            {
+                char *const first = out;
+                for (; size >= 3; in += 3, size -= 3)
+                {
+                    const uint32_t v = uint32_t(in[0]) << 16 | uint32_t(in[1]) << 8 | in[2];
+                    out[0] = BASE64_DIGITS[v >> 18];
+                    out[1] = BASE64_DIGITS[(v >> 12) & 63];
+                    out[2] = BASE64_DIGITS[(v >> 6) & 63];
+                    out[3] = BASE64_DIGITS[v & 63];
+                    out += 4;
+                }
+                if (size > 0)
+                {
+                    const uint32_t v = uint32_t(in[0]) << 16 | (size == 2 ? uint32_t(in[1]) << 8 : 0);
+                    out[0] = BASE64_DIGITS[v >> 18];
+                    out[1] = BASE64_DIGITS[(v >> 12) & 63];
+                    out[2] = size == 2 ? BASE64_DIGITS[(v >> 6) & 63] : PADDING;
+                    out[3] = PADDING;
+                    out += 4;
+                }
+                return static_cast<std::size_t>(out - first);
+            }
+
+            /**
+             * Decode `length` characters without padding, of which `length % 4` must not be 1.
+             */
+            void base64_decode_scalar(char const *in, std::size_t length, uint8_t *out)
+            {
+                uint32_t v = 0;
+                unsigned int digits = 0;
+                for (char const *const last = in + length; in != last; ++in)
+                {
+                    const uint8_t d = values.base64[static_cast<unsigned char>(*in)];
+                    if (d == INVALID)
+                        throw std::out_of_range("invalid base64 character");
+                    v = v << 6 | d;
+                    if (++digits == 4)
+                    {
+                        out[0] = static_cast<uint8_t>(v >> 16);
+                        out[1] = static_cast<uint8_t>(v >> 8);
+                        out[2] = static_cast<uint8_t>(v);
+                        out += 3;
+                        v = 0;
+                        digits = 0;
+                    }
+                }
+                // 2 digits hold one byte, 3 digits two
+                v <<= 6 * (4 - digits);
+                for (unsigned int i = 1; i < digits; ++i)
+                {
+                    *out++ = static_cast<uint8_t>(v >> (24 - 8 * i));
+                }
+            }
+
+#ifdef TXTZ_X86_SIMD
+            /*
+             * The SIMD coders follow W. Muła and D. Lemire, "Faster Base64
+             * Encoding and Decoding Using AVX2 Instructions" (2018). They
+             * process whole blocks and return how many bytes (encoding) or
+             * characters (decoding) they consumed, leaving the rest, and any
+             * invalid character, to the scalar coders.
+             */
+
+            /**
+             * Spread each group of 3 bytes over 4 bytes holding 6 bits each,
+             * so that 16 bytes per lane hold the values of 16 digits.
+             */
+            __attribute__((target("ssse3"))) __m128i base64_split(__m128i in)
+            {
+                in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+                const __m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+                const __m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+                return _mm_or_si128(hi, lo);
+            }
+
+            /**
+             * Map values 0 to 63 to their digits by adding an offset per range.
+             */
+            __attribute__((target("ssse3"))) __m128i base64_digits(__m128i v)
+            {
+                __m128i range = _mm_subs_epu8(v, _mm_set1_epi8(51));
+                range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), v), _mm_set1_epi8(13)));
+                const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+                return _mm_add_epi8(v, _mm_shuffle_epi8(offsets, range));
+            }
+
+            /**
+             * @return mask of the characters in `[first, last]`; characters above 127 are in no range
+             */
+            __attribute__((target("ssse3"))) __m128i in_range(__m128i c, char first, char last)
+            {
+                return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(static_cast<char>(first - 1))),
+                                     _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(last + 1)), c));
+            }
+
+            /**
+             * Map digits to their values.
+             *
+             * @param valid receives a mask of the characters that are digits
+             */
+            __attribute__((target("ssse3"))) __m128i base64_values(__m128i c, int &valid)
+            {
+                const __m128i upper = in_range(c, 'A', 'Z');
+                const __m128i lower = in_range(c, 'a', 'z');
+                const __m128i digit = in_range(c, '0', '9');
+                const __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+                const __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+                valid = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), slash));
+                const __m128i shift = _mm_or_si128(_mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71))),
+                                                   _mm_or_si128(_mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)), _mm_and_si128(plus, _mm_set1_epi8(19))),
+                                                                _mm_and_si128(slash, _mm_set1_epi8(16))));
+                return _mm_add_epi8(c, shift);
+            }
+
+            /**
+             * Join the 6 bit values of 4 bytes to 3 bytes, in the low 12 bytes.
+             */
+            __attribute__((target("ssse3"))) __m128i base64_join(__m128i v)
+            {
+                v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+                v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+                return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            }
+
+            __attribute__((target("ssse3"))) std::size_t base64_encode_ssse3(uint8_t const *in, std::size_t size, char *out)
+            {
+                std::size_t i = 0;
+                // 16 bytes are loaded, of which 12 are encoded
+                for (; size - i >= 16; i += 12, out += 16)
+                {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), base64_digits(base64_split(v)));
+                }
+                return i;
+            }
+
+            __attribute__((target("ssse3"))) std::size_t base64_decode_ssse3(char const *in, std::size_t length, uint8_t *out)
+            {
+                std::size_t i = 0;
+                // 16 bytes are stored, of which 12 are decoded; the 8 characters left yield 6 more bytes
+                for (; length - i >= 16 + 8; i += 16, out += 12)
+                {
+                    int valid;
+                    const __m128i v = base64_values(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i)), valid);
+                    if (valid != 0xffff)
+                        break;
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), base64_join(v));
+                }
+                return i;
+            }
+
+            __attribute__((target("avx2"))) __m256i base64_split(__m256i in)
+            {
+                const __m128i order = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+                in = _mm256_shuffle_epi8(in, _mm256_broadcastsi128_si256(order));
+                const __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+                const __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+                return _mm256_or_si256(hi, lo);
+            }
+
+            __attribute__((target("avx2"))) __m256i base64_digits(__m256i v)
+            {
+                __m256i range = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+                range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), v), _mm256_set1_epi8(13)));
+                const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                      '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+                return _mm256_add_epi8(v, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(offsets), range));
+            }
+
+            __attribute__((target("avx2"))) __m256i in_range(__m256i c, char first, char last)
+            {
+                return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(static_cast<char>(first - 1))),
+                                        _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(last + 1)), c));
+            }
+
+            __attribute__((target("avx2"))) __m256i base64_values(__m256i c, int &valid)
+            {
+                const __m256i upper = in_range(c, 'A', 'Z');
+                const __m256i lower = in_range(c, 'a', 'z');
+                const __m256i digit = in_range(c, '0', '9');
+                const __m256i plus = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('+'));
+                const __m256i slash = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('/'));
+                valid = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), _mm256_or_si256(digit, plus)), slash));
+                const __m256i shift = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(upper, _mm256_set1_epi8(-65)), _mm256_and_si256(lower, _mm256_set1_epi8(-71))),
+                                                      _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8(4)), _mm256_and_si256(plus, _mm256_set1_epi8(19))),
+                                                                      _mm256_and_si256(slash, _mm256_set1_epi8(16))));
+                return _mm256_add_epi8(c, shift);
+            }
+
+            /**
+             * Join the 6 bit values of 4 bytes to 3 bytes, in the low 24 bytes.
+             */
+            __attribute__((target("avx2"))) __m256i base64_join(__m256i v)
+            {
+                v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+                v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+                const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+                v = _mm256_shuffle_epi8(v, _mm256_broadcastsi128_si256(order));
+                return _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+            }
+
+            __attribute__((target("avx2"))) std::size_t base64_encode_avx2(uint8_t const *in, std::size_t size, char *out)
+            {
+                std::size_t i = 0;
+                // each lane is loaded with 16 bytes, of which 12 are encoded
+                for (; size - i >= 28; i += 24, out += 32)
+                {
+                    const __m128i lo = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+                    const __m128i hi = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i + 12));
+                    const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), base64_digits(base64_split(v)));
+                }
+                return i;
+            }
+
+            __attribute__((target("avx2"))) std::size_t base64_decode_avx2(char const *in, std::size_t length, uint8_t *out)
+            {
+                std::size_t i = 0;
+                // 32 bytes are stored, of which 24 are decoded; the 12 characters left yield 9 more bytes
+                for (; length - i >= 32 + 12; i += 32, out += 24)
+                {
+                    int valid;
+                    const __m256i v = base64_values(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i)), valid);
+                    if (valid != -1)
+                        break;
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), base64_join(v));
+                }
+                return i;
+            }
+
+            enum class isa_t
+            {
+                scalar,
+                ssse3,
+                avx2,
+            };
+
+            isa_t detect_isa()
+            {
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2"))
+                    return isa_t::avx2;
+                if (__builtin_cpu_supports("ssse3"))
+                    return isa_t::ssse3;
+                return isa_t::scalar;
+            }
+
+            const isa_t isa = detect_isa();
+#endif
+
+            std::size_t base64_encode(uint8_t const *in, std::size_t size, char *out)
+            {
+                std::size_t done = 0;
+#ifdef TXTZ_X86_SIMD
+                if (isa == isa_t::avx2)
+                {
+                    done = base64_encode_avx2(in, size, out);
+                }
+                else if (isa == isa_t::ssse3)
+                {
+                    done = base64_encode_ssse3(in, size, out);
+                }
+#endif
+                return done / 3 * 4 + base64_encode_scalar(in + done, size - done, out + done / 3 * 4);
+            }
+
+            std::size_t base64_decode(char const *in, std::size_t length, uint8_t *out, std::size_t capacity)
+            {
+                if (length % 4 == 0 && length > 0 && in[length - 1] == PADDING)
+                {
+                    length -= in[length - 2] == PADDING ? 2 : 1;
+                }
+                if (length % 4 == 1)
+                    throw std::out_of_range("invalid base64 length");
+                const std::size_t size = length / 4 * 3 + (length % 4 == 0 ? 0 : length % 4 - 1);
+                if (size > capacity)
+                    throw std::length_error("output buffer too small");
+                std::size_t done = 0;
+#ifdef TXTZ_X86_SIMD
+                if (isa == isa_t::avx2)
+                {
+                    done = base64_decode_avx2(in, length, out);
+                }
+                else if (isa == isa_t::ssse3)
+                {
+                    done = base64_decode_ssse3(in, length, out);
+                }
+#endif
+                base64_decode_scalar(in + done, length - done, out + done / 4 * 3);
+                return size;
+            }
+
+            /**
+             * Write the 5 digits of `v`, most significant first, to `out`.
+             */
+            void base85_digits(uint32_t v, char *out)
+            {
+                for (int i = 4; i >= 0; --i)
+                {
+                    out[i] = BASE85_DIGITS[v % 85];
+                    v /= 85;
+                }
+            }
+
+            std::size_t base85_encode(uint8_t const *in, std::size_t size, char *out)
+            {
+                char *const first = out;
+                for (; size >= 4; in += 4, size -= 4)
+                {
+                    base85_digits(uint32_t(in[0]) << 24 | uint32_t(in[1]) << 16 | uint32_t(in[2]) << 8 | in[3], out);
+                    out += 5;
+                }
+                if (size > 0)
+                {
+                    // pad with zeros and keep as many digits as needed to restore the bytes
+                    uint32_t v = 0;
+                    for (std::size_t i = 0; i < 4; ++i)
+                    {
+                        v = v << 8 | (i < size ? in[i] : 0);
+                    }
+                    char digits[5];
+                    base85_digits(v, digits);
+                    std::memcpy(out, digits, size + 1);
+                    out += size + 1;
+                }
+                return static_cast<std::size_t>(out - first);
+            }
+
+            /**
+             * @return the value of the 5 digits at `in`
+             * @throw std::out_of_range if a digit is invalid or the value exceeds 32 bits
+             */
+            uint32_t base85_value(char const *in)
+            {
+                uint64_t v = 0;
+                for (int i = 0; i < 5; ++i)
+                {
+                    const uint8_t d = values.base85[static_cast<unsigned char>(in[i])];
+                    if (d == INVALID)
+                        throw std::out_of_range("invalid base85 character");
+                    v = v * 85 + d;
+                }
+                if (v > 0xffffffffU)
+                    throw std::out_of_range("invalid base85 group");
+                return static_cast<uint32_t>(v);
+            }
+
+            std::size_t base85_decode(char const *in, std::size_t length, uint8_t *out, std::size_t capacity)
+            {
+                if (length % 5 == 1)
+                    throw std::out_of_range("invalid base85 length");
+                const std::size_t size = length / 5 * 4 + (length % 5 == 0 ? 0 : length % 5 - 1);
+                if (size > capacity)
+                    throw std::length_error("output buffer too small");
+                for (; length >= 5; in += 5, length -= 5)
+                {
+                    const uint32_t v = base85_value(in);
+                    out[0] = static_cast<uint8_t>(v >> 24);
+                    out[1] = static_cast<uint8_t>(v >> 16);
+                    out[2] = static_cast<uint8_t>(v >> 8);
+                    out[3] = static_cast<uint8_t>(v);
+                    out += 4;
+                }
+                if (length > 0)
+                {
+                    // padding with the highest digit restores the bytes the digits were cut from
+                    char digits[5];
+                    std::fill(std::begin(digits), std::end(digits), BASE85_DIGITS[84]);
+                    std::memcpy(digits, in, length);
+                    const uint32_t v = base85_value(digits);
+                    for (std::size_t i = 0; i + 1 < length; ++i)
+                    {
+                        out[i] = static_cast<uint8_t>(v >> (24 - 8 * i));
+                    }
+                }
+                return size;
+            }
+        }
+
+        encoding_t encoding_from_string(std::string const &name)
+        {
+            if (name == "base64")
+                return encoding_t::base64;
+            if (name == "base85")
+                return encoding_t::base85;
+            throw std::invalid_argument("unknown text encoding '" + name + "'");
+        }
+
+        std::size_t encoded_size(encoding_t encoding, std::size_t size)
+        {
+            if (encoding == encoding_t::base64)
+                return (size + 2) / 3 * 4;
+            return size / 4 * 5 + (size % 4 == 0 ? 0 : size % 4 + 1);
+        }
+
+        std::size_t decoded_size_bound(encoding_t encoding, std::size_t length)
+        {
+            if (encoding == encoding_t::base64)
+                return length / 4 * 3 + 2;
+            return length / 5 * 4 + 3;
+        }
+
+        std::size_t encode(encoding_t encoding, uint8_t const *in, std::size_t size, char *out, std::size_t capacity)
+        {
+            if (encoded_size(encoding, size) > capacity)
+                throw std::length_error("output buffer too small");
+            if (encoding == encoding_t::base64)
+                return base64_encode(in, size, out);
+            return base85_encode(in, size, out);
+        }
+
+        std::size_t decode(encoding_t encoding, char const *in, std::size_t length, uint8_t *out, std::size_t capacity)
+        {
+            if (encoding == encoding_t::base64)
+                return base64_decode(in, length, out, capacity);
+            return base85_decode(in, length, out, capacity);
+        }
+
+        char const *instruction_set()
+        {
+#ifdef TXTZ_X86_SIMD
+            if (isa == isa_t::avx2)
+                return "avx2";
+            if (isa == isa_t::ssse3)
+                return "ssse3";
+#endif
+            return "scalar";
+        }
+
+        std::size_t codec::compress(std::string_view in, char *out, std::size_t capacity, std::size_t &bits) const
+        {
+            binary_buffer.resize(z_.compress_bound(in.size()));
+            const std::size_t size = z_.compress(in, binary_buffer.data(), binary_buffer.size(), bits);
+            return encode(encoding_, binary_buffer.data(), size, out, capacity);
+        }
+
+        void codec::compress(std::vector<std::string_view> const &strings, std::string &out, std::size_t &bits) const
+        {
+            bits = 0;
+            for (auto const &s : strings)
+            {
+                const std::size_t pos = out.size();
+                out.resize(pos + compress_bound(s.size()));
+                std::size_t string_bits;
+                out.resize(pos + compress(s, out.data() + pos, out.size() - pos, string_bits));
+                out.push_back('\n');
+                bits += string_bits;
+            }
+        }
+
+        std::size_t codec::decompress(char const *in, std::size_t length, char *out, std::size_t capacity) const
+        {
+            binary_buffer.resize(decoded_size_bound(encoding_, length));
+            const std::size_t size = decode(encoding_, in, length, binary_buffer.data(), binary_buffer.size());
+            return z_.decompress(binary_buffer.data(), size, out, capacity);
+        }
+
+        void codec::decompress(std::string_view in, std::string &out) const
+        {
+            while (!in.empty())
+            {
+                const std::size_t eol = std::min(in.find('\n'), in.size());
+                std::string_view line = in.substr(0, eol);
+                in.remove_prefix(std::min(eol + 1, in.size()));
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.remove_suffix(1);
+                }
+                binary_buffer.resize(decoded_size_bound(encoding_, line.size()));
+                const std::size_t size = decode(encoding_, line.data(), line.size(), binary_buffer.data(), binary_buffer.size());
+                // the decompressed size isn't known, so grow the room for it until the result fits;
+                // every bit may complete a token
+                const std::size_t pos = out.size();
+                const std::size_t max_size = 8 * size * z_.max_token_length();
+                std::size_t room = std::min(max_size, 4 * size + 64);
+                for (;;)
+                {
+                    out.resize(pos + room);
+                    try
+                    {
+                        out.resize(pos + z_.decompress(binary_buffer.data(), size, out.data() + pos, room));
+                        break;
+                    }
+                    catch (std::length_error const &)
+                    {
+                        if (room >= max_size)
+                            throw;
+                        room = std::min(max_size, 2 * room);
+                    }
+                }
+                out.push_back('\n');
+            }
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __TEXT_HPP__
+#define __TEXT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "txtz.hpp"
+
+namespace txtz
+{
+    /**
+     * Text-safe encodings of compressed data, e.g. for JSON documents or
+     * text columns of a database.
+     *
+     *  - `base64` is the standard alphabet of RFC 4648 with `=` padding;
+     *    decoding also accepts unpadded text.
+     *  - `base85` is the Z85 alphabet, which contains neither quotes nor
+     *    backslashes. Four bytes become five digits; a final group of
+     *    n < 4 bytes becomes n + 1 digits, like in Ascii85.
+     *
+     * On x86 processors, base64 is encoded and decoded with SSSE3 or AVX2
+     * instructions where the processor supports them, detected at runtime.
+     */
+    namespace text
+    {
+        enum class encoding_t
+        {
+            base64,
+            base85,
+        };
+
+        /**
+         * @throw std::invalid_argument if `name` is neither "base64" nor "base85"
+         */
+        encoding_t encoding_from_string(std::string const &name);
+
+        /**
+         * @return number of characters `size` bytes are encoded to
+         */
+        std::size_t encoded_size(encoding_t encoding, std::size_t size);
+
+        /**
+         * @return number of bytes sufficient to hold `length` decoded characters
+         */
+        std::size_t decoded_size_bound(encoding_t encoding, std::size_t length);
+
+        /**
+         * Encode the `size` bytes at `in` into the `capacity` characters at `out`.
+         *
+         * @return number of characters written to `out`
+         * @throw std::length_error if `out` is too small, see `encoded_size()`
+         */
+        std::size_t encode(encoding_t encoding, uint8_t const *in, std::size_t size, char *out, std::size_t capacity);
+
+        /**
+         * Decode the `length` characters at `in` into the `capacity` bytes at `out`.
+         *
+         * @return number of bytes written to `out`
+         * @throw std::length_error if `out` is too small, see `decoded_size_bound()`
+         * @throw std::out_of_range if the text isn't valid in this encoding
+         */
+        std::size_t decode(encoding_t encoding, char const *in, std::size_t length, uint8_t *out, std::size_t capacity);
+
+        /**
+         * @return name of the instruction set base64 is coded with, i.e. "avx2", "ssse3" or "scalar"
+         */
+        char const *instruction_set();
+
+        /**
+         * Compresses strings straight to text: the compressed data goes
+         * to a per-thread buffer, which stays in the cache until it is
+         * encoded, and nothing else is allocated per string.
+         */
+        class codec final
+        {
+        public:
+            codec(txtz const &z, encoding_t encoding)
+                : z_(z), encoding_(encoding) {}
+
+            encoding_t encoding() const
+            {
+                return encoding_;
+            }
+
+            /**
+             * @return number of characters sufficient to hold `size` bytes compressed and encoded
+             */
+            std::size_t compress_bound(std::size_t size) const
+            {
+                return encoded_size(encoding_, z_.compress_bound(size));
+            }
+
+            /**
+             * Compress and encode `in` into the `capacity` characters at `out`.
+             *
+             * @param bits receives the number of bits the compressed data has
+             * @return number of characters written to `out`
+             * @throw std::length_error if `out` is too small, see `compress_bound()`
+             * @throw std::invalid_argument if the input contains a character without code
+             */
+            std::size_t compress(std::string_view in, char *out, std::size_t capacity, std::size_t &bits) const;
+
+            /**
+             * Compress and encode each of `strings` on its own and append
+             * them to `out`, one line per string.
+             *
+             * @param bits receives the number of bits the compressed data has
+             * @throw std::invalid_argument if a string contains a character without code
+             */
+            void compress(std::vector<std::string_view> const &strings, std::string &out, std::size_t &bits) const;
+
+            /**
+             * Decode and decompress the `length` characters at `in` into the `capacity` bytes at `out`.
+             *
+             * @return number of bytes written to `out`
+             * @throw std::length_error if `out` is too small
+             * @throw std::out_of_range if the text or the compressed data is corrupt
+             */
+            std::size_t decompress(char const *in, std::size_t length, char *out, std::size_t capacity) const;
+
+            /**
+             * Decode and decompress every line of `in`, as written by
+             * `compress()`, and append them to `out`, one line per string.
+             *
+             * @throw std::out_of_range if the text or the compressed data is corrupt
+             */
+            void decompress(std::string_view in, std::string &out) const;
+
+        private:
+            txtz z_;
+            encoding_t encoding_;
+        };
+    }
+}
+
+#endif // __TEXT_HPP__
@@ -0,0 +1,226 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#ifndef __TRIE_HPP__
+#define __TRIE_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * A byte-wise prefix tree to find the longest key at the start of a string
+ * in one forward pass, instead of looking up every possible length.
+ *
+ * The tree is stored as a double array: the child of node `n` for byte `c`
+ * lives in slot `base(n) + c`, and the slot records its parent, so that
+ * following an edge is a single array access and a comparison. Values
+ * are kept in the slots, so a lookup touches nothing but its path.
+ */
+template <typename T>
+class trie
+{
+public:
+    struct slot
+    {
+        static constexpr uint32_t FREE = std::numeric_limits<uint32_t>::max();
+        static constexpr uint32_t ROOT = FREE - 1;
+
+        /**
+         * Offset of the children of this node.
+         */
+        uint32_t base;
+        /**
+         * Index of the parent node, `FREE` if the slot is unused.
+         */
+        uint32_t parent;
+        /**
+         * Whether a key ends here.
+         */
+        bool has_value;
+        T value;
+    };
+
+    /**
+     * Build the trie from `entries`, replacing any previous content.
+     * Empty keys are ignored.
+     *
+     * @throw std::invalid_argument if a key occurs twice
+     */
+    void build(std::vector<std::pair<std::string_view, T>> entries)
+    {
+        entries.erase(std::remove_if(std::begin(entries), std::end(entries), [](auto const &e)
+                                     { return e.first.empty(); }),
+                      std::end(entries));
+        std::sort(std::begin(entries), std::end(entries), [](auto const &a, auto const &b)
+                  { return a.first < b.first; });
+        struct pending
+        {
+            uint32_t index;
+            std::size_t first;
+            std::size_t last;
+            std::size_t depth;
+        };
+        slots_.assign(1, slot{0, slot::ROOT, false, T{}});
+        // all entries below a node share a prefix of `depth` bytes
+        std::vector<pending> queue{pending{0, 0, entries.size(), 0}};
+        std::vector<std::pair<unsigned char, std::pair<std::size_t, std::size_t>>> children;
+        std::size_t first_free = 1;
+        for (std::size_t q = 0; q < queue.size(); ++q)
+        {
+            const pending p = queue[q];
+            std::size_t first = p.first;
+            if (first != p.last && entries[first].first.size() == p.depth)
+            {
+                if (first + 1 != p.last && entries[first + 1].first.size() == p.depth)
+                    throw std::invalid_argument("duplicate key");
+                slots_[p.index].has_value = true;
+                slots_[p.index].value = entries[first].second;
+                ++first;
+            }
+            children.clear();
+            while (first != p.last)
+            {
+                const unsigned char byte = static_cast<unsigned char>(entries[first].first[p.depth]);
+                std::size_t last = first;
+                while (last != p.last && static_cast<unsigned char>(entries[last].first[p.depth]) == byte)
+                {
+                    ++last;
+                }
+                children.push_back({byte, {first, last}});
+                first = last;
+            }
+            if (children.empty())
+                continue;
+            // first fit: the lowest base at which all children find a free slot
+            while (first_free < slots_.size() && slots_[first_free].parent != slot::FREE)
+            {
+                ++first_free;
+            }
+            std::size_t base = first_free > children.front().first ? first_free - children.front().first : 0;
+            for (;; ++base)
+            {
+                if (base + children.back().first >= slots_.size())
+                {
+                    slots_.resize(base + children.back().first + 1, slot{0, slot::FREE, false, T{}});
+                }
+                if (std::all_of(std::begin(children), std::end(children), [this, base](auto const &c)
+                                { return slots_[base + c.first].parent == slot::FREE; }))
+                    break;
+            }
+            if (base + 256 > slot::ROOT)
+                throw std::length_error("trie too large");
+            slots_[p.index].base = static_cast<uint32_t>(base);
+            for (auto const &c : children)
+            {
+                const uint32_t index = static_cast<uint32_t>(base + c.first);
+                slots_[index].parent = p.index;
+                queue.push_back(pending{index, c.second.first, c.second.second, p.depth + 1});
+            }
+        }
+        // every lookup may probe up to 255 slots beyond the last base
+        slots_.resize(slots_.size() + 256, slot{0, slot::FREE, false, T{}});
+        slots_.shrink_to_fit();
+    }
+
+    /**
+     * Find the longest key that `[it, last)` starts with.
+     *
+     * @param length receives the length of the key
+     * @return value of the key, `nullptr` if no key matches
+     */
+    T const *longest_match(char const *it, char const *last, std::size_t &length) const
+    {
+        T const *best = nullptr;
+        uint32_t n = 0;
+        for (std::size_t depth = 1; it != last; ++depth, ++it)
+        {
+            const uint32_t child = slots_[n].base + static_cast<unsigned char>(*it);
+            if (slots_[child].parent != n)
+                break;
+            n = child;
+            if (slots_[n].has_value)
+            {
+                best = &slots_[n].value;
+                length = depth;
+            }
+        }
+        return best;
+    }
+
+    /**
+     * Split `[it, last)` into keys like repeated calls of `longest_match()`
+     * do and add up the values of the keys to `sum`, without handing out
+     * values and lengths in between.
+     *
+     * @return false if some part of the string doesn't start with a key
+     */
+    bool sum_longest_matches(char const *it, char const *last, std::size_t &sum) const
+    {
+        while (it != last)
+        {
+            char const *end = nullptr;
+            std::size_t w = 0;
+            uint32_t n = 0;
+            for (char const *p = it; p != last; ++p)
+            {
+                const uint32_t child = slots_[n].base + static_cast<unsigned char>(*p);
+                if (slots_[child].parent != n)
+                    break;
+                n = child;
+                if (slots_[n].has_value)
+                {
+                    w = slots_[n].value;
+                    end = p + 1;
+                }
+            }
+            if (end == nullptr)
+                return false;
+            sum += w;
+            it = end;
+        }
+        return true;
+    }
+
+    /**
+     * @return number of bytes occupied by the slots
+     */
+    std::size_t memory_usage() const
+    {
+        return slots_.capacity() * sizeof(slot);
+    }
+
+private:
+    std::vector<slot> slots_;
+};
+
+#endif // __TRIE_HPP__
@@ -26,29 +26,72 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iterator>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "batch.hpp"
+#include "container.hpp"
+#include "frontcode.hpp"
 #include "getopt.hpp"
+#include "mapped_file.hpp"
 #include "mappings.hpp"
+#include "pipeline.hpp"
+#include "record.hpp"
+#include "text.hpp"
 #include "txtz.hpp"
-#include "shannon-fano.hpp"
+#include "util.hpp"
 
 namespace fs = std::filesystem;
 
 namespace
 {
+    constexpr std::size_t DEFAULT_BLOCK_SIZE = 1U << 20;
+    constexpr std::size_t MAX_BLOCK_SIZE = 1U << 28;
+
     typedef enum
     {
         INVALID_OP,
         COMPRESS,
         DECOMPRESS,
+        ESTIMATE,
     } opmode_t;
+
+    /**
+     * Call `fn` with every line of `block`, without its line feed and,
+     * if `strip_crlf` is set, without a carriage return in front of it.
+     *
+     * @return number of bytes in the lines handed to `fn`
+     */
+    template <typename LineF>
+    std::size_t split_lines(txtz::pipeline::block const &block, bool strip_crlf, LineF fn)
+    {
+        std::size_t bytes = 0;
+        std::string_view text(block.data(), block.size());
+        while (!text.empty())
+        {
+            const std::size_t eol = std::min(text.find('\n'), text.size());
+            std::string_view line = text.substr(0, eol);
+            text.remove_prefix(std::min(eol + 1, text.size()));
+            if (strip_crlf && !line.empty() && line.back() == '\r')
+            {
+                line.remove_suffix(1);
+            }
+            bytes += line.size();
+            fn(line);
+        }
+        return bytes;
+    }
 }
 
 auto is_deleter = [](std::istream *ptr) -> void
@@ -76,6 +119,18 @@ int main(int argc, char *argv[])
     opmode_t op = INVALID_OP;
     bool strip_crlf = true;
     bool stats_only_output = false;
+    bool records = false;
+    char separator = ',';
+    long field = -1;
+    bool front_coding = false;
+    bool use_container = false;
+    bool batch_codes = false;
+    bool text = false;
+    txtz::text::encoding_t text_encoding = txtz::text::encoding_t::base64;
+    std::string algo = txtz::compression_table_algorithm;
+    std::size_t restart_interval = txtz::front_codec::DEFAULT_RESTART_INTERVAL;
+    std::size_t block_size = DEFAULT_BLOCK_SIZE;
+    unsigned int num_workers = std::max(1U, std::thread::hardware_concurrency());
     std::string input_filename;
     std::string output_filename;
     std::unique_ptr<std::istream, decltype(is_deleter)> in{nullptr, is_deleter};
@@ -87,10 +142,37 @@ int main(int argc, char *argv[])
              { op = DECOMPRESS; })
         .reg({"-c", "--compress"}, argparser::no_argument, "Compress data", [&op](std::string const &)
              { op = COMPRESS; })
+        .reg({"-e", "--estimate"}, argparser::no_argument, "Estimate the compressed size of every line without compressing", [&op](std::string const &)
+             { op = ESTIMATE; })
+        .reg({"-a", "--algo"}, "ALGO", argparser::required_argument, std::string("Use the codes built with this algorithm, huffman or shannon-fano (default: ") + txtz::compression_table_algorithm + "); decompress with the same one, as only containers record which one was used", [&algo](std::string const &arg)
+             { algo = arg; })
         .reg({"--no-remove-crlf"}, argparser::no_argument, "Don't remove CR/LF from input.", [&strip_crlf](std::string const &)
              { strip_crlf = false; })
         .reg({"--stats", "--stats-only"}, argparser::no_argument, "Only output compression statistics.", [&stats_only_output](std::string const &)
              { stats_only_output = true; })
+        .reg({"-r", "--records"}, argparser::no_argument, "Treat every line as a record of fields, each compressed with a dictionary of its own.", [&records](std::string const &)
+             { records = true; })
+        .reg({"--separator"}, "CHAR", argparser::required_argument, "Field separator in records (default: \",\")", [&separator](std::string const &arg)
+             { separator = arg.front(); })
+        .reg({"--field"}, "N", argparser::required_argument, "Only decompress field N (counting from 0) of each record", [&field](std::string const &arg)
+             { field = std::stol(arg); })
+        .reg({"--front-coding"}, argparser::no_argument, "Compress sorted lines, storing only what differs from the previous line", [&front_coding](std::string const &)
+             { front_coding = true; })
+        .reg({"--restart-interval"}, "N", argparser::required_argument, "Lines between two restart points in front coded lists (default: 16)", [&restart_interval](std::string const &arg)
+             { restart_interval = std::stoul(arg); })
+        .reg({"--batch-codes"}, argparser::no_argument, "Compress the lines of every block with codes made for them, stored in the block", [&batch_codes](std::string const &)
+             { batch_codes = true; })
+        .reg({"-t", "--text"}, "ENCODING", argparser::required_argument, "Write every line compressed on its own as a line of base64 or base85 text, or decompress such lines", [&text, &text_encoding](std::string const &arg)
+             {
+                 text = true;
+                 text_encoding = txtz::text::encoding_from_string(arg);
+             })
+        .reg({"--container"}, argparser::no_argument, "Compress the input as is in independent blocks followed by an index, for large files", [&use_container](std::string const &)
+             { use_container = true; })
+        .reg({"-b", "--block-size"}, "BYTES", argparser::required_argument, "Compress input in blocks of this size (default: 1 MiB)", [&block_size](std::string const &arg)
+             { block_size = std::stoul(arg); })
+        .reg({"-j", "--jobs"}, "N", argparser::required_argument, "Number of worker threads (default: number of cores)", [&num_workers](std::string const &arg)
+             { num_workers = static_cast<unsigned int>(std::max(1UL, std::stoul(arg))); })
         .reg({"-i", "--input-file"}, "INPUT_FILENAME", argparser::required_argument, "input file", [&input_filename](std::string const &arg)
              { input_filename = arg; })
         .reg({"-o", "--output-file"}, "OUTPUT_FILENAME", argparser::required_argument, "Where the output goes to", [&output_filename](std::string const &arg)
@@ -114,9 +196,15 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    if (block_size == 0 || block_size > MAX_BLOCK_SIZE)
+    {
+        std::cerr << "\u001b[31;1mERROR: block size must be between 1 and " << MAX_BLOCK_SIZE << " bytes.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
     if (op == INVALID_OP)
     {
-        std::cerr << "\u001b[31;1mERROR: operation mode missing, please give -c or -d.\u001b[0m\n";
+        std::cerr << "\u001b[31;1mERROR: operation mode missing, please give -c, -d or -e.\u001b[0m\n";
         return EXIT_FAILURE;
     }
 
@@ -143,57 +231,430 @@ int main(int argc, char *argv[])
         out.reset(new std::ofstream(output_filename, std::ios::trunc | std::ios::binary));
     }
 
-    std::vector<char> in_buf(std::istreambuf_iterator<char>(*in), {});
-    txtz::txtz z(txtz::compression_table);
+    if (records && txtz::record_tables.empty())
+    {
+        std::cerr << "\u001b[31;1mERROR: no record dictionaries built in (see RECORD_FIELDS).\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (field >= 0 && (!records || op != DECOMPRESS || static_cast<std::size_t>(field) >= txtz::record_tables.size()))
+    {
+        std::cerr << "\u001b[31;1mERROR: --field needs -d, --records and a field number below " << txtz::record_tables.size() << ".\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
+    if (front_coding && (records || op == ESTIMATE))
+    {
+        std::cerr << "\u001b[31;1mERROR: --front-coding can't be combined with --records or -e.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (batch_codes && (records || front_coding || op == ESTIMATE))
+    {
+        std::cerr << "\u001b[31;1mERROR: --batch-codes can't be combined with --records, --front-coding or -e.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (use_container && (records || front_coding || batch_codes || op == ESTIMATE))
+    {
+        std::cerr << "\u001b[31;1mERROR: --container can't be combined with --records, --front-coding, --batch-codes or -e.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (use_container && op == DECOMPRESS && input_filename.empty())
+    {
+        std::cerr << "\u001b[31;1mERROR: decompressing a container needs an input file (-i), as its index is at the end.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (text && (records || front_coding || batch_codes || use_container || op == ESTIMATE))
+    {
+        std::cerr << "\u001b[31;1mERROR: --text can't be combined with --records, --front-coding, --batch-codes, --container or -e.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (restart_interval == 0)
+    {
+        std::cerr << "\u001b[31;1mERROR: --restart-interval must be positive.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
 
-    switch (op)
+    if (records && algo != txtz::compression_table_algorithm)
     {
-    case COMPRESS:
+        std::cerr << "\u001b[31;1mERROR: record dictionaries are only built with " << txtz::compression_table_algorithm << ".\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    std::unordered_map<std::string, txtz::code> const *table;
+    try
+    {
+        table = &txtz::compression_table_for(algo);
+    }
+    catch (std::invalid_argument const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << ".\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    const txtz::txtz z(*table, txtz::compression_table_normalization, txtz::specialization_for(*table));
+    std::unique_ptr<txtz::record_codec> rc;
+    if (records)
+    {
+        rc = std::make_unique<txtz::record_codec>(txtz::record_tables, separator, txtz::compression_table_normalization);
+    }
+    const txtz::front_codec fc(z, restart_interval);
+    const txtz::batch_codec bc(z);
+    const txtz::text::codec tc(z, text_encoding);
+    txtz::pipeline pipe(num_workers, 2 * std::size_t(num_workers) + 1);
+    std::atomic<std::size_t> bytes_in{0};
+    std::size_t bytes_out = 0;
+    std::atomic<std::size_t> num_bits{0};
+    auto write_block = [&out, &bytes_out, stats_only_output](txtz::pipeline::block const &b)
     {
         if (!stats_only_output)
         {
-            std::cout << "Compressing with " <<
-#if defined(ALGO_HUFFMAN)
-                "Huffmann"
-#elif defined(ALGO_SHANNON_FANO)
-                "Shannon-Fano"
-#else
-#error "Invalid map building algorithm. Define one of ALGO_HUFFMAN or ALGO_SHANNON_FANO!"
-#endif
-                      << " encoded binary tree ...\n";
+            out->write(b.data(), static_cast<std::streamsize>(b.size()));
         }
-        std::string s;
-        if (strip_crlf)
+        bytes_out += b.size();
+    };
+
+    try
+    {
+        switch (op)
         {
-            std::copy_if(std::begin(in_buf), std::end(in_buf), std::back_inserter(s), [](char c)
-                         { return c != '\r' && c != '\n'; });
+        case COMPRESS:
+        {
+            if (!stats_only_output)
+            {
+                std::cerr << "Compressing with " << (algo == "huffman" ? "Huffman" : "Shannon-Fano") << " encoded binary tree ...\n";
+            }
+            std::vector<std::vector<uint8_t>> buffers(num_workers);
+            // each line becomes a record, stored as its compressed size followed by the compressed data
+            auto compress_records = [&](unsigned int worker, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                auto &buf = buffers[worker];
+                std::vector<uint8_t> records_data;
+                std::size_t block_bits = 0;
+                auto compress_record = [&](std::string_view line)
+                {
+                    buf.resize(rc->compress_bound(line.size()));
+                    std::size_t bits;
+                    const std::size_t size = rc->compress(line, buf.data(), buf.size(), bits);
+                    block_bits += bits;
+                    util::append_varint(records_data, size);
+                    records_data.insert(std::end(records_data), std::begin(buf), std::begin(buf) + static_cast<std::ptrdiff_t>(size));
+                };
+                bytes_in += split_lines(in_block, strip_crlf, compress_record);
+                num_bits += block_bits;
+                std::vector<uint8_t> header;
+                util::append_varint(header, records_data.size());
+                out_block.assign(std::begin(header), std::end(header));
+                out_block.insert(std::end(out_block), std::begin(records_data), std::end(records_data));
+            };
+            // the lines of a block become one front coded list, stored as its size followed by the list
+            auto compress_front_coded = [&](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                std::vector<std::string_view> lines;
+                bytes_in += split_lines(in_block, strip_crlf, [&lines](std::string_view line)
+                                        { lines.push_back(line); });
+                std::size_t bits;
+                const std::vector<uint8_t> list = fc.compress(lines, bits);
+                num_bits += bits;
+                std::vector<uint8_t> header;
+                util::append_varint(header, list.size());
+                out_block.assign(std::begin(header), std::end(header));
+                out_block.insert(std::end(out_block), std::begin(list), std::end(list));
+            };
+            // the lines of a block become a batch with codes of its own, stored as its size followed by the batch
+            auto compress_batch = [&](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                std::vector<std::string_view> lines;
+                bytes_in += split_lines(in_block, strip_crlf, [&lines](std::string_view line)
+                                        { lines.push_back(line); });
+                std::size_t bits;
+                const std::vector<uint8_t> batch = bc.compress(lines, bits);
+                num_bits += bits;
+                std::vector<uint8_t> header;
+                util::append_varint(header, batch.size());
+                out_block.assign(std::begin(header), std::end(header));
+                out_block.insert(std::end(out_block), std::begin(batch), std::end(batch));
+            };
+            // every line becomes a line of text
+            auto compress_text = [&](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                std::vector<std::string_view> lines;
+                bytes_in += split_lines(in_block, strip_crlf, [&lines](std::string_view line)
+                                        { lines.push_back(line); });
+                std::size_t bits;
+                std::string output;
+                tc.compress(lines, output, bits);
+                num_bits += bits;
+                out_block.assign(std::begin(output), std::end(output));
+            };
+            auto compress_block = [&](unsigned int worker, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                std::string s;
+                if (strip_crlf)
+                {
+                    std::copy_if(std::begin(in_block), std::end(in_block), std::back_inserter(s), [](char c)
+                                 { return c != '\r' && c != '\n'; });
+                }
+                else
+                {
+                    s.assign(std::begin(in_block), std::end(in_block));
+                }
+                bytes_in += s.size();
+                auto &buf = buffers[worker];
+                buf.resize(z.compress_bound(s.size()));
+                std::size_t bits;
+                const std::size_t size = z.compress(s, buf.data(), buf.size(), bits);
+                num_bits += bits;
+                std::vector<uint8_t> header;
+                util::append_varint(header, size);
+                out_block.reserve(header.size() + size);
+                out_block.assign(std::begin(header), std::end(header));
+                out_block.insert(std::end(out_block), std::begin(buf), std::begin(buf) + static_cast<std::ptrdiff_t>(size));
+            };
+            // the block is compressed as is; its uncompressed size goes in front, for the index
+            auto compress_container_block = [&](unsigned int worker, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                bytes_in += in_block.size();
+                auto &buf = buffers[worker];
+                std::size_t bits;
+                txtz::container::compress_block(z, std::string_view(in_block.data(), in_block.size()), buf, bits);
+                num_bits += bits;
+                std::vector<uint8_t> header;
+                util::append_varint(header, in_block.size());
+                out_block.reserve(header.size() + buf.size());
+                out_block.assign(std::begin(header), std::end(header));
+                out_block.insert(std::end(out_block), std::begin(buf), std::end(buf));
+            };
+            if (use_container)
+            {
+                std::unique_ptr<txtz::mapped_file> file;
+                txtz::pipeline::reader read = txtz::pipeline::line_reader(*in, block_size);
+                if (!input_filename.empty())
+                {
+                    file = std::make_unique<txtz::mapped_file>(input_filename);
+                    read = txtz::pipeline::memory_reader(reinterpret_cast<char const *>(file->data()), file->size(), block_size);
+                }
+                std::ostream discard(nullptr); // writing to a stream without buffer does nothing
+                txtz::container::writer cw(stats_only_output ? discard : *out, z, txtz::container::table_from_string(algo));
+                pipe.run(read, compress_container_block, [&cw](txtz::pipeline::block const &b)
+                         {
+                             auto const *data = reinterpret_cast<uint8_t const *>(b.data());
+                             std::size_t length;
+                             const std::size_t header_size = util::read_varint(data, b.size(), length);
+                             cw.append(data + header_size, b.size() - header_size, length); });
+                cw.finish();
+                bytes_out = cw.size();
+            }
+            else if (records)
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), compress_records, write_block);
+            }
+            else if (front_coding)
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), compress_front_coded, write_block);
+            }
+            else if (batch_codes)
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), compress_batch, write_block);
+            }
+            else if (text)
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), compress_text, write_block);
+            }
+            else
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size), compress_block, write_block);
+            }
+            const float ratio = 100 * float(bytes_out) / float(bytes_in);
+            if (stats_only_output)
+            {
+                std::cout << std::setprecision(3) << ratio << '\n';
+            }
+            else
+            {
+                std::cerr << (8 * bytes_in) << " bits -> " << num_bits << " bits (" << bytes_out << " bytes), compressed to " << std::setprecision(3) << ratio << "% of original size.\n";
+            }
+            break;
         }
-        std::vector<uint8_t> out_buf;
-        std::size_t sz;
-        out_buf = z.compress(s, sz);
-        if (stats_only_output)
+        case DECOMPRESS:
         {
-            std::cout << std::setprecision(3) << 100 * float(out_buf.size()) / (float(s.size())) << '\n';
+            if (!stats_only_output)
+                std::cerr << "Decompressing ...\n";
+            auto read_block = [&in, &bytes_in](txtz::pipeline::block &b) -> bool
+            {
+                std::size_t size = 0;
+                std::size_t header_size = 0;
+                for (int shift = 0;; shift += 7)
+                {
+                    const int c = in->get();
+                    if (c == std::char_traits<char>::eof())
+                    {
+                        if (header_size == 0)
+                            return false;
+                        throw std::runtime_error("input truncated");
+                    }
+                    ++header_size;
+                    size |= static_cast<std::size_t>(c & 0x7f) << shift;
+                    if ((c & 0x80) == 0)
+                        break;
+                    if (shift > 56)
+                        throw std::runtime_error("invalid block header");
+                }
+                // no code is longer than 64 bits, so a compressed block can't
+                // take more than 8 bytes per input byte plus a few for framing
+                if (size > 8 * MAX_BLOCK_SIZE + 16)
+                    throw std::runtime_error("invalid block size");
+                b.resize(size);
+                in->read(b.data(), static_cast<std::streamsize>(size));
+                if (static_cast<std::size_t>(in->gcount()) != size)
+                    throw std::runtime_error("input truncated");
+                bytes_in += header_size + size;
+                return true;
+            };
+            auto decompress_block = [&z](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                auto const &s = z.decompress(in_block);
+                out_block.assign(std::begin(s), std::end(s));
+            };
+            auto decompress_records = [&rc, field](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                auto const *data = reinterpret_cast<uint8_t const *>(in_block.data());
+                std::size_t size = in_block.size();
+                out_block.clear();
+                while (size > 0)
+                {
+                    std::size_t record_size;
+                    const std::size_t header_size = util::read_varint(data, size, record_size);
+                    if (header_size == 0 || record_size > size - header_size)
+                        throw std::runtime_error("invalid record size");
+                    data += header_size;
+                    size -= header_size;
+                    // every bit may complete a token, and there's a separator between two fields
+                    const std::size_t pos = out_block.size();
+                    out_block.resize(pos + 8 * record_size * rc->max_token_length() + rc->fields());
+                    const std::size_t length = field < 0
+                                                   ? rc->decompress(data, record_size, out_block.data() + pos, out_block.size() - pos)
+                                                   : rc->decompress_field(data, record_size, static_cast<std::size_t>(field), out_block.data() + pos, out_block.size() - pos);
+                    out_block.resize(pos + length);
+                    out_block.push_back('\n');
+                    data += record_size;
+                    size -= record_size;
+                }
+            };
+            auto decompress_front_coded = [&fc](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                out_block.clear();
+                for (auto const &line : fc.decompress(reinterpret_cast<uint8_t const *>(in_block.data()), in_block.size()))
+                {
+                    out_block.insert(std::end(out_block), std::begin(line), std::end(line));
+                    out_block.push_back('\n');
+                }
+            };
+            auto decompress_batch = [&bc](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                out_block.clear();
+                for (auto const &line : bc.decompress(reinterpret_cast<uint8_t const *>(in_block.data()), in_block.size()))
+                {
+                    out_block.insert(std::end(out_block), std::begin(line), std::end(line));
+                    out_block.push_back('\n');
+                }
+            };
+            auto decompress_text = [&tc, &bytes_in](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                bytes_in += in_block.size();
+                std::string output;
+                tc.decompress(std::string_view(in_block.data(), in_block.size()), output);
+                out_block.assign(std::begin(output), std::end(output));
+            };
+            if (use_container)
+            {
+                const txtz::mapped_file file(input_filename);
+                const txtz::container::reader cr(file.data(), file.size(), z, txtz::container::table_from_string(algo));
+                bytes_in = file.size();
+                // workers decode straight from the mapped file, so the blocks passed on only carry the block number
+                std::size_t next = 0;
+                auto read_block_number = [&cr, &next](txtz::pipeline::block &b) -> bool
+                {
+                    if (next == cr.block_count())
+                        return false;
+                    std::vector<uint8_t> number;
+                    util::append_varint(number, next++);
+                    b.assign(std::begin(number), std::end(number));
+                    return true;
+                };
+                auto decompress_container_block = [&cr](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+                {
+                    std::size_t i;
+                    util::read_varint(reinterpret_cast<uint8_t const *>(in_block.data()), in_block.size(), i);
+                    out_block.resize(cr.length(i));
+                    cr.decompress(i, out_block.data(), out_block.size());
+                };
+                pipe.run(read_block_number, decompress_container_block, write_block);
+            }
+            else if (records)
+            {
+                pipe.run(read_block, decompress_records, write_block);
+            }
+            else if (front_coding)
+            {
+                pipe.run(read_block, decompress_front_coded, write_block);
+            }
+            else if (batch_codes)
+            {
+                pipe.run(read_block, decompress_batch, write_block);
+            }
+            else if (text)
+            {
+                pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), decompress_text, write_block);
+            }
+            else
+            {
+                pipe.run(read_block, decompress_block, write_block);
+            }
+            if (!stats_only_output)
+                std::cerr << (8 * bytes_in) << " -> " << (8 * bytes_out) << '\n';
+            break;
         }
-        else
+        case ESTIMATE:
         {
-            std::copy(std::begin(out_buf), std::end(out_buf), std::ostream_iterator<char>(*out));
-            std::cout << (8 * s.size()) << " bits -> " << sz << " bits (" << out_buf.size() << " bytes), compressed to " << std::setprecision(3) << 100 * float(out_buf.size()) / (float(s.size())) << "% of original size.\n";
+            std::atomic<std::size_t> num_strings{0};
+            std::atomic<std::size_t> bytes_estimated{0};
+            // every line is a string of its own, stored in whole bytes
+            auto estimate_block = [&](unsigned int, txtz::pipeline::block const &in_block, txtz::pipeline::block &out_block)
+            {
+                std::size_t strings = 0;
+                std::size_t bits = 0;
+                std::size_t bytes = 0;
+                auto estimate_line = [&](std::string_view line)
+                {
+                    const std::size_t string_bits = rc ? rc->compressed_bits(line) : z.compressed_bits(line);
+                    ++strings;
+                    bits += string_bits;
+                    bytes += (string_bits + 7) / 8;
+                };
+                bytes_in += split_lines(in_block, strip_crlf, estimate_line);
+                num_strings += strings;
+                num_bits += bits;
+                bytes_estimated += bytes;
+                out_block.clear();
+            };
+            pipe.run(txtz::pipeline::line_reader(*in, block_size, MAX_BLOCK_SIZE), estimate_block, write_block);
+            const float ratio = 100 * float(bytes_estimated) / float(bytes_in);
+            if (stats_only_output)
+            {
+                *out << std::setprecision(3) << ratio << '\n';
+            }
+            else
+            {
+                *out << num_strings << " strings, " << bytes_in << " bytes -> " << num_bits << " bits, "
+                     << bytes_estimated << " bytes compressed (" << std::setprecision(3) << ratio << "% of original size)\n";
+            }
+            break;
+        }
+        case INVALID_OP: // will never be reached
+            break;
         }
-        break;
     }
-    case DECOMPRESS:
+    catch (std::exception const &e)
     {
-        if (!stats_only_output)
-            std::cout << "Decompressing ...\n";
-        auto out_buf = z.decompress(in_buf);
-        std::copy(std::begin(out_buf), std::end(out_buf), std::ostream_iterator<char>(*out));
-        std::cout << '\n'
-                  << (8 * in_buf.size()) << " -> " << (8 * out_buf.size()) << '\n';
-        break;
-    }
-    case INVALID_OP: // will never be reached
-        break;
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+        return EXIT_FAILURE;
     }
 
     return EXIT_SUCCESS;
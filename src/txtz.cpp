@@ -27,100 +27,370 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "bitio.hpp"
 #include "shannon-fano.hpp"
 #include "huffman.hpp"
+#include "normalize.hpp"
 #include "txtz.hpp"
+#include "util.hpp"
 
 namespace txtz
 {
 
-    txtz::txtz(std::unordered_map<std::string, code> const &table)
-        : compress_table_(table)
+    namespace
+    {
+        /**
+         * Holds folded text on its way into or out of the coder.
+         */
+        thread_local std::string normalization_buffer;
+    }
+
+    namespace
     {
+        txtz::framing_t default_framing(std::unordered_map<std::string, code> const &table)
+        {
+            return table.find(std::string(&txtz::STOP_TOKEN, 1)) != std::end(table)
+                       ? txtz::framing_t::stop_token
+                       : txtz::framing_t::length_prefix;
+        }
+    }
+
+    txtz::dictionary::dictionary(std::unordered_map<std::string, code> const &table, framing_t framing, normalization_t normalization,
+                                 specialization const *specialized, decoder_t decoder)
+        : compress_table_(table), framing_(framing), normalization_(normalization), decoder_(decoder),
+          specialized_(specialized != nullptr && specialized->framing == framing ? specialized : nullptr)
+    {
+        if (framing_ == framing_t::stop_token && compress_table_.find(std::string(&STOP_TOKEN, 1)) == std::end(compress_table_))
+            throw std::invalid_argument("stop token framing requires a code table containing the stop token");
+        std::vector<decltype(decompress_tree_)::entry> entries;
+        entries.reserve(compress_table_.size());
+        std::vector<std::pair<std::string_view, token_code>> tokens;
+        tokens.reserve(compress_table_.size());
+        std::vector<std::pair<std::string_view, uint8_t>> lengths;
+        lengths.reserve(compress_table_.size());
         for (auto const &it : compress_table_)
         {
-            decompress_tree_.append(it.second.bits(), it.second.bitcount(), it.first);
+            entries.push_back({it.second.bits(), static_cast<uint32_t>(it.second.bitcount()), it.first});
+            tokens.emplace_back(it.first, token_code{it.second.bits(), it.second.bitcount()});
+            lengths.emplace_back(it.first, static_cast<uint8_t>(it.second.bitcount()));
             if (it.first.size() > max_token_length_)
             {
                 max_token_length_ = it.first.size();
             }
+            // compare bits/length ratios without dividing
+            if (!it.first.empty() && it.second.bitcount() * worst_length_ > worst_bits_ * it.first.size())
+            {
+                worst_bits_ = it.second.bitcount();
+                worst_length_ = it.first.size();
+            }
+        }
+        if (framing_ == framing_t::stop_token)
+        {
+            stop_code_ = compress_table_.at(std::string(&STOP_TOKEN, 1));
+        }
+        tokens_.build(std::move(tokens));
+        token_lengths_.build(std::move(lengths));
+        decompress_tree_.build(std::move(entries));
+        if (decoder_ == decoder_t::multi_symbol)
+        {
+            if (decompress_tree_.max_code_length() <= decltype(decompress_table_)::MAX_CODE_LENGTH)
+            {
+                decompress_table_.build(decompress_tree_);
+            }
+            else
+            {
+                decoder_ = decoder_t::bit_serial;
+            }
+        }
+    }
+
+    txtz::txtz(std::unordered_map<std::string, code> const &table)
+        : txtz(table, default_framing(table), normalization_t::none)
+    {
+    }
+
+    txtz::txtz(std::unordered_map<std::string, code> const &table, framing_t framing)
+        : txtz(table, framing, normalization_t::none)
+    {
+    }
+
+    txtz::txtz(std::unordered_map<std::string, code> const &table, normalization_t normalization)
+        : txtz(table, default_framing(table), normalization)
+    {
+    }
+
+    txtz::txtz(std::unordered_map<std::string, code> const &table, framing_t framing, normalization_t normalization)
+        : dict_(std::make_shared<dictionary const>(table, framing, normalization))
+    {
+    }
+
+    txtz::txtz(std::unordered_map<std::string, code> const &table, normalization_t normalization, specialization const *specialized)
+        : dict_(std::make_shared<dictionary const>(table, default_framing(table), normalization, specialized))
+    {
+    }
+
+    txtz::txtz(std::shared_ptr<dictionary const> dict)
+        : txtz(std::move(dict), nullptr)
+    {
+    }
+
+    txtz::txtz(std::shared_ptr<dictionary const> dict, std::shared_ptr<memo_cache> cache)
+        : dict_(std::move(dict)), cache_(std::move(cache))
+    {
+        if (!dict_)
+            throw std::invalid_argument("dictionary missing");
+    }
+
+    std::size_t txtz::compress_bound(std::size_t size) const
+    {
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            // every byte may end up with a marker in front of it
+            size *= 2;
+        }
+        std::size_t header_size = 0;
+        std::size_t payload_bits = (size * dict_->worst_bits_ + dict_->worst_length_ - 1) / dict_->worst_length_;
+        if (dict_->framing_ == framing_t::length_prefix)
+        {
+            header_size = util::varint_size(size);
+        }
+        else
+        {
+            payload_bits += dict_->stop_code_.bitcount();
+        }
+        return header_size + (payload_bits + 7) / 8;
+    }
+
+    std::size_t txtz::compress(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const
+    {
+        std::size_t size;
+        if (cache_ && cache_->compressed_.get(in, out, capacity, size, bits))
+            return size;
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            normalize::fold(in.data(), in.size(), normalization_buffer);
+            size = encode(normalization_buffer, out, capacity, bits);
+        }
+        else
+        {
+            size = encode(in, out, capacity, bits);
+        }
+        if (cache_)
+        {
+            cache_->compressed_.put(in, out, size, bits);
+        }
+        return size;
+    }
+
+    std::size_t txtz::encode(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const
+    {
+        std::size_t header_size = 0;
+        if (dict_->framing_ == framing_t::length_prefix)
+        {
+            header_size = util::write_varint(out, capacity, in.size());
+            if (header_size == 0)
+                throw std::length_error("output buffer too small");
+        }
+        if (dict_->specialized_ != nullptr)
+        {
+            const std::size_t size = dict_->specialized_->encode(in.data(), in.size(), out + header_size, capacity - header_size, bits);
+            bits += 8 * header_size;
+            return header_size + size;
+        }
+        bit_writer writer(out + header_size, capacity - header_size);
+        bits = 8 * header_size;
+        char const *it = in.data();
+        char const *const last = it + in.size();
+        while (it != last)
+        {
+            std::size_t length;
+            auto const &found = longest_match(it, last, length);
+            writer.put(found.bits, found.bitcount);
+            bits += found.bitcount;
+            it += length;
+        }
+        if (dict_->framing_ == framing_t::stop_token)
+        {
+            writer.put(dict_->stop_code_.bits(), dict_->stop_code_.bitcount());
+            bits += dict_->stop_code_.bitcount();
+        }
+        return header_size + writer.finish();
+    }
+
+    txtz::dictionary::token_code const &txtz::longest_match(char const *it, char const *last, std::size_t &length) const
+    {
+        auto const *found = dict_->tokens_.longest_match(it, last, length);
+        if (found == nullptr)
+            throw std::invalid_argument("input contains a character without code");
+        return *found;
+    }
+
+    std::size_t txtz::compressed_bits(std::string_view in) const
+    {
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            normalize::fold(in.data(), in.size(), normalization_buffer);
+            in = normalization_buffer;
+        }
+        std::size_t bits = dict_->framing_ == framing_t::length_prefix
+                               ? 8 * util::varint_size(in.size())
+                               : dict_->stop_code_.bitcount();
+        if (!dict_->token_lengths_.sum_longest_matches(in.data(), in.data() + in.size(), bits))
+            throw std::invalid_argument("input contains a character without code");
+        return bits;
+    }
+
+    void txtz::count_tokens(std::string_view in, std::unordered_map<std::string, std::size_t> &counts) const
+    {
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            normalize::fold(in.data(), in.size(), normalization_buffer);
+            in = normalization_buffer;
+        }
+        char const *it = in.data();
+        char const *const last = it + in.size();
+        while (it != last)
+        {
+            std::size_t length;
+            longest_match(it, last, length);
+            ++counts[std::string(it, length)];
+            it += length;
+        }
+    }
+
+    std::size_t txtz::decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const
+    {
+        const std::string_view key(reinterpret_cast<char const *>(in), size);
+        std::size_t length;
+        std::size_t bits;
+        if (cache_ && cache_->decompressed_.get(key, out, capacity, length, bits))
+            return length;
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            // folding at most doubles the length, and no code stands for more than `max_token_length()` bytes
+            normalization_buffer.resize(std::min(2 * capacity, 8 * size * dict_->max_token_length_));
+            length = decode(in, size, normalization_buffer.data(), normalization_buffer.size());
+            length = normalize::unfold(normalization_buffer.data(), length, out, capacity);
+        }
+        else
+        {
+            length = decode(in, size, out, capacity);
+        }
+        if (cache_)
+        {
+            cache_->decompressed_.put(key, out, length, 0);
+        }
+        return length;
+    }
+
+    std::size_t txtz::decode(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const
+    {
+        if (dict_->framing_ == framing_t::length_prefix)
+        {
+            std::size_t length;
+            const std::size_t header_size = read_length_prefix(in, size, length);
+            if (length > capacity)
+                throw std::length_error("output buffer too small");
+            if (dict_->specialized_ != nullptr)
+                return dict_->specialized_->decode(in + header_size, size - header_size, out, length);
+            if (dict_->decoder_ == decoder_t::multi_symbol)
+            {
+                dict_->decompress_table_.decompress_exactly(in + header_size, size - header_size, out, length);
+            }
+            else
+            {
+                dict_->decompress_tree_.decompress_exactly(in + header_size, size - header_size, out, length);
+            }
+            return length;
         }
+        if (dict_->specialized_ != nullptr)
+            return dict_->specialized_->decode(in, size, out, capacity);
+        if (dict_->decoder_ == decoder_t::multi_symbol)
+            return dict_->decompress_table_.decompress(in, size, out, capacity);
+        return dict_->decompress_tree_.decompress(in, size, out, capacity);
+    }
+
+    std::size_t txtz::read_length_prefix(uint8_t const *in, std::size_t size, std::size_t &length) const
+    {
+        const std::size_t header_size = util::read_varint(in, size, length);
+        if (header_size == 0)
+            throw std::out_of_range("invalid length prefix");
+        // every code has at least one bit, so the payload can't hold more tokens than bits
+        if (length / dict_->max_token_length_ > 8 * (size - header_size))
+            throw std::out_of_range("length prefix exceeds what the compressed data can hold");
+        return header_size;
+    }
+
+    std::vector<uint8_t> txtz::compress(std::string const &str, std::size_t &size) const
+    {
+        std::vector<uint8_t> compressed_data(compress_bound(str.size()));
+        compressed_data.resize(compress(str, compressed_data.data(), compressed_data.size(), size));
+        return compressed_data;
     }
 
-    std::vector<uint8_t> txtz::compress(std::string const &str, std::size_t &size)
+    std::string txtz::decompress(std::vector<uint8_t> const &data) const
     {
-        std::vector<uint8_t> compressed_data;
-        const std::string &uncompressed = str + STOP_TOKEN;
-        const std::size_t max_len = std::min(max_token_length_, uncompressed.size());
-        auto it = std::begin(uncompressed);
-        auto chunk_end = std::min(std::begin(uncompressed) + max_len, std::end(uncompressed));
-        const auto last = std::end(uncompressed);
-        uint8_t byte = 0;
-        long num_bits = 0;
-        int bit_idx = 0;
-        while (it < last)
+        std::string result;
+        const std::string_view key(reinterpret_cast<char const *>(data.data()), data.size());
+        if (cache_ && cache_->decompressed_.get(key, result))
+            return result;
+        if (dict_->framing_ == framing_t::length_prefix)
+        {
+            std::size_t length;
+            read_length_prefix(data.data(), data.size(), length);
+            result.resize(length);
+            decode(data.data(), data.size(), result.data(), length);
+        }
+        else if (dict_->specialized_ != nullptr || dict_->decoder_ == decoder_t::multi_symbol)
         {
-            while (it < chunk_end)
+            // the decompressed size isn't known, so grow the buffer until the result fits
+            const std::size_t max_size = 8 * data.size() * dict_->max_token_length_;
+            result.resize(std::min(max_size, 4 * data.size() + 64));
+            for (;;)
             {
-                std::string token(it, chunk_end);
-                if (compress_table_.find(token) != compress_table_.end())
+                try
                 {
-                    code const &c = compress_table_.at(token);
-                    code_t value = c.bits() << (8 * sizeof(code_t) - c.bitcount());
-                    num_bits += static_cast<long>(c.bitcount());
-                    // XXX: slow bit by bit encoder
-                    for (std::size_t i = 0; i < c.bitcount(); ++i)
-                    {
-                        byte <<= 1;
-                        constexpr code_t mask = (1ULL << (8 * sizeof(code_t) - 1));
-                        if ((value & mask) != 0)
-                        {
-                            byte |= 1;
-                        }
-                        else
-                        {
-                        }
-                        value <<= 1;
-                        if (++bit_idx == 8)
-                        {
-                            compressed_data.push_back(byte);
-                            byte = 0b00000000;
-                            bit_idx = 0;
-                        }
-                    }
-                    it += token.size();
-                    chunk_end = std::min(it + max_len, std::end(uncompressed));
+                    result.resize(decode(data.data(), data.size(), result.data(), result.size()));
+                    break;
                 }
-                else
+                catch (std::length_error const &)
                 {
-                    --chunk_end;
+                    if (result.size() >= max_size)
+                        throw;
+                    result.resize(std::min(max_size, 2 * result.size()));
                 }
             }
         }
-        if (bit_idx > 0)
+        else
         {
-            byte <<= 8 - bit_idx;
-            compressed_data.push_back(byte);
+            result = dict_->decompress_tree_.decompress(data);
         }
-        size = num_bits;
-        return compressed_data;
-    }
-
-    std::string txtz::decompress(std::vector<uint8_t> const &data)
-    {
-        return decompress_tree_.decompress(data);
+        if (dict_->normalization_ == normalization_t::fold_case)
+        {
+            // unfolding never makes the text longer, so it can be done in place
+            result.resize(normalize::unfold(result.data(), result.size(), result.data(), result.size()));
+        }
+        if (cache_)
+        {
+            cache_->decompressed_.put(key, result.data(), result.size(), 0);
+        }
+        return result;
     }
 
-    std::string txtz::decompress(std::vector<char> const &data)
+    std::string txtz::decompress(std::vector<char> const &data) const
     {
         std::vector<uint8_t> byte_data(data.size());
         std::transform(std::begin(data), std::end(data), std::begin(byte_data), [](char b) -> uint8_t
                        { return static_cast<uint8_t>(b); });
-        return decompress_tree_.decompress(byte_data);
+        return decompress(byte_data);
     }
 
 }
@@ -29,41 +29,375 @@
 #define __TXTZ_HPP__
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "bintree.hpp"
 #include "code.hpp"
+#include "memo.hpp"
+#include "multitable.hpp"
+#include "trie.hpp"
 
 namespace txtz
 {
 
     /**
      * A class to efficiently compress and decompress short strings.
+     *
+     * A `txtz` is a lightweight handle to an immutable `dictionary`.
+     * Copies share the dictionary, and all member functions are `const`
+     * and may be called from any number of threads at once; the only
+     * mutable state is the output buffer the caller passes in and a
+     * per-thread buffer for normalization.
      */
     class txtz final
     {
     public:
         static constexpr char STOP_TOKEN = '\xff'; // 0xFF isn't found in any UTF-8 continuation bytes
+
+        /**
+         * How the end of a compressed string is marked.
+         */
+        enum class framing_t
+        {
+            /**
+             * The bit stream is terminated by the code of `STOP_TOKEN`.
+             */
+            stop_token,
+            /**
+             * The bit stream is preceded by the length of the
+             * uncompressed string, stored as a LEB128 varint.
+             * The code table doesn't need a stop token.
+             */
+            length_prefix,
+        };
+
+        /**
+         * What happens to the input before it is tokenized.
+         */
+        enum class normalization_t
+        {
+            /**
+             * The input is tokenized as is.
+             */
+            none,
+            /**
+             * The input is composed to NFC and lowercased, capitalization
+             * is kept as markers (see `normalize::fold()`). The code table
+             * must have been built from text folded the same way.
+             */
+            fold_case,
+        };
+
+        /**
+         * How the generic decoder finds the codes in the bit stream.
+         */
+        enum class decoder_t
+        {
+            /**
+             * Walk the decoding tree one bit at a time.
+             */
+            bit_serial,
+            /**
+             * Look up the next 12 bits in a table that yields all tokens
+             * complete within them (see `multitable`), walking the tree
+             * only for longer codes. Falls back to `bit_serial` if a code
+             * is longer than 56 bits.
+             */
+            multi_symbol,
+        };
+
+        /**
+         * Encoder and decoder generated for one particular code table by
+         * `mapbuilder --specialize`, with the codes and tokens compiled in.
+         * They replace the generic trie and decoding tree, not framing or
+         * normalization.
+         */
+        struct specialization
+        {
+            framing_t framing;
+            /**
+             * Encode the tokens of the `size` bytes at `in` and, with stop token
+             * framing, the stop code. A length prefix is written by the caller.
+             *
+             * @param bits receives the number of bits written
+             * @return number of bytes written to `out`
+             */
+            std::size_t (*encode)(char const *in, std::size_t size, uint8_t *out, std::size_t capacity, std::size_t &bits);
+            /**
+             * With stop token framing, decode until the stop code or the end
+             * of the input into at most `capacity` bytes; with length-prefixed
+             * framing, decode exactly `capacity` bytes.
+             *
+             * @return number of bytes written to `out`
+             */
+            std::size_t (*decode)(uint8_t const *in, std::size_t size, char *out, std::size_t capacity);
+        };
+
+        /**
+         * A code table together with everything derived from it, i.e. the
+         * decoding tree, framing and normalization. Built once and never
+         * changed, so it can be shared without synchronization.
+         */
+        class dictionary final
+        {
+        public:
+            /**
+             * `specialized` is used if it was generated for `framing`; it
+             * must have been generated from this very table.
+             *
+             * @throw std::invalid_argument if stop token framing is requested but the table lacks `STOP_TOKEN`
+             */
+            dictionary(std::unordered_map<std::string, code> const &, framing_t, normalization_t,
+                       specialization const *specialized = nullptr, decoder_t decoder = decoder_t::multi_symbol);
+            dictionary(dictionary const &) = delete;
+            dictionary &operator=(dictionary const &) = delete;
+
+            /**
+             * @return number of bytes occupied by the token tries and the decoding tree and table
+             */
+            std::size_t memory_usage() const
+            {
+                return tokens_.memory_usage() + token_lengths_.memory_usage() + decompress_tree_.memory_usage() + decompress_table_.memory_usage();
+            }
+
+        private:
+            friend class txtz;
+
+            /**
+             * For compression a lookup table is needed. Each entry is
+             * indexed by the word to look up. The entry of type `code`
+             * contains a prefix free bit sequence along with a value
+             * for its length.
+             */
+            std::unordered_map<std::string, code> compress_table_;
+
+            /**
+             * Code of a token as the encoder needs it.
+             */
+            struct token_code
+            {
+                code_t bits;
+                unsigned long bitcount;
+            };
+
+            /**
+             * Holds the codes of `compress_table_` by their tokens, so that
+             * the longest token at some position is found in a single pass
+             * over its bytes.
+             */
+            trie<token_code> tokens_;
+
+            /**
+             * The same tokens with nothing but their code lengths, so that
+             * `compressed_bits()` walks slots a third the size of those in
+             * `tokens_`.
+             */
+            trie<uint8_t> token_lengths_;
+
+            /**
+             * For decompression a binary tree is needed.
+             */
+            bintree<code_t, uint32_t, uint8_t> decompress_tree_{std::string(&STOP_TOKEN, 1)};
+            /**
+             * Decodes several codes per lookup, built from `decompress_tree_`
+             * unless `decoder_` is `bit_serial`.
+             */
+            multitable<decltype(decompress_tree_)> decompress_table_;
+            std::size_t max_token_length_{};
+            /**
+             * Code length and token length of the token with the most code
+             * bits per input byte. No tokenization of `n` bytes can take
+             * more than `n * worst_bits_ / worst_length_` bits.
+             */
+            std::size_t worst_bits_{};
+            std::size_t worst_length_{1};
+            framing_t framing_;
+            normalization_t normalization_;
+            decoder_t decoder_;
+            code stop_code_;
+            specialization const *specialized_{nullptr};
+        };
+
+        /**
+         * Use stop token framing if the table contains `STOP_TOKEN`,
+         * length-prefixed framing otherwise.
+         */
         explicit txtz(std::unordered_map<std::string, code> const &);
-        std::vector<uint8_t> compress(std::string const &, std::size_t &);
-        std::string decompress(std::vector<uint8_t> const &);
-        std::string decompress(std::vector<char> const &);
+
+        /**
+         * @throw std::invalid_argument if stop token framing is requested but the table lacks `STOP_TOKEN`
+         */
+        txtz(std::unordered_map<std::string, code> const &, framing_t);
+
+        /**
+         * Choose framing like the single argument constructor does.
+         */
+        txtz(std::unordered_map<std::string, code> const &, normalization_t);
+
+        /**
+         * @throw std::invalid_argument if stop token framing is requested but the table lacks `STOP_TOKEN`
+         */
+        txtz(std::unordered_map<std::string, code> const &, framing_t, normalization_t);
+
+        /**
+         * Choose framing like the single argument constructor does and use
+         * `specialized` (may be null) instead of the generic coder.
+         */
+        txtz(std::unordered_map<std::string, code> const &, normalization_t, specialization const *specialized);
+
+        /**
+         * Share an existing dictionary.
+         *
+         * @throw std::invalid_argument if `dict` is null
+         */
+        explicit txtz(std::shared_ptr<dictionary const> dict);
+
+        /**
+         * Share an existing dictionary and look up strings in `cache` (may be
+         * null) before compressing or decompressing them. The cache must only
+         * be used with this dictionary.
+         *
+         * @throw std::invalid_argument if `dict` is null
+         */
+        txtz(std::shared_ptr<dictionary const> dict, std::shared_ptr<memo_cache> cache);
+
+        std::shared_ptr<dictionary const> const &shared_dictionary() const
+        {
+            return dict_;
+        }
+
+        std::vector<uint8_t> compress(std::string const &, std::size_t &) const;
+
+        /**
+         * Compress `in` into the `capacity` bytes at `out`, e.g. a buffer on
+         * the stack of `compress_bound(in.size())` bytes. Nothing is allocated.
+         * With normalization, a per-thread buffer holds the folded input; it
+         * only grows when a longer string comes along.
+         *
+         * @param bits receives the number of bits written
+         * @return number of bytes written to `out`
+         * @throw std::length_error if `out` is too small, see `compress_bound()`
+         * @throw std::invalid_argument if the input contains a character without code
+         */
+        std::size_t compress(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const;
+
+        std::size_t compress(std::string_view in, uint8_t *out, std::size_t capacity) const
+        {
+            std::size_t bits;
+            return compress(in, out, capacity, bits);
+        }
+
+        /**
+         * Number of bits `compress()` would report for `in`, computed by
+         * tokenizing `in` and summing up the code lengths, without writing
+         * any output.
+         *
+         * @throw std::invalid_argument if the input contains a character without code
+         */
+        std::size_t compressed_bits(std::string_view in) const;
+
+        /**
+         * Split `in` into tokens like `compress()` does and count how
+         * often each token occurs.
+         *
+         * @throw std::invalid_argument if the input contains a character without code
+         */
+        void count_tokens(std::string_view in, std::unordered_map<std::string, std::size_t> &counts) const;
+
+        /**
+         * Worst case size of the compressed form of `size` bytes with this
+         * dictionary. It assumes every byte is coded at the highest rate of
+         * bits per byte any token of the table has, which is usually far
+         * less than the longest code for every byte.
+         *
+         * @return number of bytes sufficient to hold `size` compressed bytes
+         */
+        std::size_t compress_bound(std::size_t size) const;
+
+        /**
+         * Decompress the `size` bytes at `in` into the `capacity` bytes at `out`
+         * without allocating memory (with normalization, see `compress()`).
+         *
+         * @return number of bytes written to `out`
+         * @throw std::length_error if `out` is too small
+         * @throw std::out_of_range if the compressed data is corrupt
+         */
+        std::size_t decompress(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const;
+
+        std::string decompress(std::vector<uint8_t> const &) const;
+        std::string decompress(std::vector<char> const &) const;
+
+        framing_t framing() const
+        {
+            return dict_->framing_;
+        }
+
+        std::size_t max_token_length() const
+        {
+            return dict_->max_token_length_;
+        }
+
+        normalization_t normalization() const
+        {
+            return dict_->normalization_;
+        }
+
+        decoder_t decoder() const
+        {
+            return dict_->decoder_;
+        }
+
+        /**
+         * @return whether a generated encoder and decoder are in use
+         */
+        bool specialized() const
+        {
+            return dict_->specialized_ != nullptr;
+        }
+
+        std::unordered_map<std::string, code> const &table() const
+        {
+            return dict_->compress_table_;
+        }
+
+        std::shared_ptr<memo_cache> const &cache() const
+        {
+            return cache_;
+        }
 
     private:
+        std::shared_ptr<dictionary const> dict_;
+        std::shared_ptr<memo_cache> cache_;
+
+        /**
+         * Greedily find the longest token at `it`.
+         *
+         * @param length receives the length of the token
+         * @throw std::invalid_argument if not even the character at `it` has a code
+         */
+        dictionary::token_code const &longest_match(char const *it, char const *last, std::size_t &length) const;
+
+        /**
+         * Tokenize and encode without normalization.
+         */
+        std::size_t encode(std::string_view in, uint8_t *out, std::size_t capacity, std::size_t &bits) const;
+
         /**
-         * For compression a lookup table is needed. Each entry is
-         * indexed by the word to look up. The entry of type `code`
-         * contains a prefix free bit sequence along with a value
-         * for its length.
+         * Decode without undoing normalization.
          */
-        std::unordered_map<std::string, code> compress_table_;
+        std::size_t decode(uint8_t const *in, std::size_t size, char *out, std::size_t capacity) const;
 
         /**
-         * For decompression a binary tree is needed.
+         * @return size of the length prefix
+         * @throw std::out_of_range if the prefix is malformed or implausible
          */
-        bintree<code_t, uint32_t, std::string, uint8_t> decompress_tree_{std::string(&STOP_TOKEN, 1)};
-        std::size_t max_token_length_{};
+        std::size_t read_length_prefix(uint8_t const *in, std::size_t size, std::size_t &length) const;
     };
 }
 
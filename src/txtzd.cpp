@@ -0,0 +1,874 @@
+/*
+
+ Copyright (c) 2024 Oliver Lau <oliver@ersatzworld.net>
+
+ Permission is hereby granted, free of charge, to any person
+ obtaining a copy of this software and associated documentation
+ files (the “Software”), to deal in the Software without
+ restriction, including without limitation the rights to use,
+ copy, modify, merge, publish, distribute, sublicense, and/or
+ sell copies of the Software, and to permit persons to whom the
+ Software is furnished to do so, subject to the following
+ conditions:
+
+ The above copyright notice and this permission notice shall be
+ included in all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND,
+ EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE
+ AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ OTHER DEALINGS IN THE SOFTWARE.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "adaptive.hpp"
+#include "getopt.hpp"
+#include "histogram.hpp"
+#include "mappings.hpp"
+#include "protocol.hpp"
+#include "txtz.hpp"
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+    namespace protocol = txtz::protocol;
+
+    typedef enum
+    {
+        SERVE,
+        CLIENT_COMPRESS,
+        CLIENT_DECOMPRESS,
+        CLIENT_STATS,
+        CLIENT_ROUNDTRIP,
+    } opmode_t;
+
+    struct statistics
+    {
+        std::atomic<uint64_t> connections{};
+        std::atomic<uint64_t> requests[4]{};
+        std::atomic<uint64_t> errors{};
+        std::atomic<uint64_t> bytes_in{};
+        std::atomic<uint64_t> bytes_out{};
+        std::atomic<uint64_t> batches{};
+        txtz::latency_histogram latency[4];
+        /**
+         * Set if dictionaries are retrained while running.
+         */
+        txtz::adaptive_codec const *adaptive{nullptr};
+        /**
+         * Set if results are memoized.
+         */
+        txtz::memo_cache const *cache{nullptr};
+
+        std::string report() const
+        {
+            static constexpr const char *NAMES[4] = {"", "compress", "decompress", "stats"};
+            std::ostringstream oss;
+            uint64_t total = 0;
+            for (int op = protocol::COMPRESS; op <= protocol::STATS; ++op)
+            {
+                total += requests[op].load();
+            }
+            oss << "connections: " << connections.load() << '\n'
+                << "requests:    " << total << '\n';
+            for (int op = protocol::COMPRESS; op <= protocol::STATS; ++op)
+            {
+                oss << "  " << NAMES[op] << ": " << requests[op].load() << '\n';
+            }
+            oss << "errors:      " << errors.load() << '\n'
+                << "bytes in:    " << bytes_in.load() << '\n'
+                << "bytes out:   " << bytes_out.load() << '\n'
+                << "batches:     " << batches.load() << " (avg. "
+                << std::setprecision(3) << (batches.load() > 0 ? double(total) / double(batches.load()) : 0.0) << " requests per batch)\n";
+            if (adaptive != nullptr)
+            {
+                oss << "dictionary:  version " << adaptive->version() << " (" << adaptive->retrainings() << " retrainings)\n";
+            }
+            if (cache != nullptr)
+            {
+                auto const &c = cache->compress_statistics();
+                auto const &d = cache->decompress_statistics();
+                oss << "cache:       " << cache->size() << " of " << cache->capacity() << " bytes\n"
+                    << "  compress hit rate: " << std::setprecision(3) << 100 * c.hit_rate() << "% (" << c.hits << " hits, " << c.misses << " misses)\n"
+                    << "  decompress hit rate: " << std::setprecision(3) << 100 * d.hit_rate() << "% (" << d.hits << " hits, " << d.misses << " misses)\n";
+            }
+            for (int op = protocol::COMPRESS; op <= protocol::DECOMPRESS; ++op)
+            {
+                if (latency[op].count() == 0)
+                    continue;
+                auto us = [this, op](double q)
+                {
+                    return std::chrono::duration<double, std::micro>(latency[op].percentile(q)).count();
+                };
+                oss << NAMES[op] << " latency: p50 < " << us(0.5)
+                    << " us, p90 < " << us(0.9)
+                    << " us, p99 < " << us(0.99) << " us\n";
+                latency[op].print(oss);
+            }
+            return oss.str();
+        }
+    };
+
+    /**
+     * Written to by workers whenever a connection has responses due, so that
+     * the I/O thread wakes up and sends them.
+     */
+    int wakeup_pipe[2] = {-1, -1};
+
+    /**
+     * A client connection. Requests are numbered in the order they arrive;
+     * responses may be completed by any worker in any order, but are queued
+     * strictly in request order. Only the I/O thread writes to the socket,
+     * which is non-blocking, so a client that doesn't read its responses
+     * can't hold up a worker.
+     */
+    class connection
+    {
+    public:
+        explicit connection(int fd) : fd_(fd) {}
+        connection(connection const &) = delete;
+        connection &operator=(connection const &) = delete;
+        ~connection()
+        {
+            ::close(fd_);
+        }
+
+        int fd() const
+        {
+            return fd_;
+        }
+
+        /**
+         * Unparsed input, only touched by the I/O thread.
+         */
+        std::vector<uint8_t> in;
+        uint64_t next_request{0};
+        /**
+         * Cleared once the peer has closed its end or sent garbage.
+         */
+        bool reading{true};
+
+        /**
+         * @return number of requests whose responses haven't been sent completely
+         */
+        uint64_t in_flight() const
+        {
+            return next_request - sent_;
+        }
+
+        /**
+         * Hand over the response to request `seq` and queue all responses
+         * that are now due for the I/O thread.
+         */
+        void complete(uint64_t seq, std::vector<uint8_t> &&frame)
+        {
+            bool due = false;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                pending_.emplace(seq, std::move(frame));
+                auto it = pending_.begin();
+                while (it != pending_.end() && it->first == next_response_)
+                {
+                    out_.insert(std::end(out_), std::begin(it->second), std::end(it->second));
+                    frame_ends_.push_back(out_.size());
+                    it = pending_.erase(it);
+                    ++next_response_;
+                    due = true;
+                }
+            }
+            if (due)
+            {
+                const char c = 0;
+                [[maybe_unused]] auto n = ::write(wakeup_pipe[1], &c, 1); // if the pipe is full, a wakeup is pending anyway
+            }
+        }
+
+        /**
+         * Send as much of the queued responses as the socket takes without blocking.
+         *
+         * @return false if the peer went away
+         */
+        bool flush()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            while (written_ < out_.size())
+            {
+                const ssize_t n = ::send(fd_, out_.data() + written_, out_.size() - written_, 0);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        break;
+                    return false;
+                }
+                written_ += static_cast<std::size_t>(n);
+            }
+            while (!frame_ends_.empty() && frame_ends_.front() <= written_)
+            {
+                frame_ends_.pop_front();
+                ++sent_;
+            }
+            if (written_ == out_.size())
+            {
+                out_.clear();
+                frame_ends_.clear();
+                written_ = 0;
+            }
+            return true;
+        }
+
+        /**
+         * @return whether queued responses wait for the socket to become writable
+         */
+        bool has_output()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return written_ < out_.size();
+        }
+
+    private:
+        int fd_;
+        std::mutex mtx_;
+        uint64_t next_response_{0};
+        std::map<uint64_t, std::vector<uint8_t>> pending_;
+        /**
+         * Responses due in request order, of which `written_` bytes are sent.
+         */
+        std::vector<uint8_t> out_;
+        std::size_t written_{0};
+        /**
+         * End of each response in `out_` not sent completely yet.
+         */
+        std::deque<std::size_t> frame_ends_;
+        /**
+         * Responses sent completely, only touched by the I/O thread.
+         */
+        uint64_t sent_{0};
+    };
+
+    struct job
+    {
+        std::shared_ptr<connection> conn;
+        uint64_t seq;
+        uint8_t op;
+        std::vector<uint8_t> payload;
+        clock_type::time_point received;
+    };
+
+    /**
+     * Queue of jobs shared by the I/O thread and all workers.
+     * Workers take out as many waiting jobs as they can at once.
+     */
+    class job_queue
+    {
+    public:
+        void push(job &&j)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                jobs_.push_back(std::move(j));
+            }
+            cv_.notify_one();
+        }
+
+        /**
+         * Wait for jobs and move up to `max_batch_size` of them into `batch`.
+         *
+         * @return false once the queue has been stopped and drained
+         */
+        bool pop_batch(std::vector<job> &batch, std::size_t max_batch_size)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            cv_.wait(lock, [this]
+                     { return stopped_ || !jobs_.empty(); });
+            if (jobs_.empty())
+                return false;
+            const std::size_t n = std::min(max_batch_size, jobs_.size());
+            std::move(std::begin(jobs_), std::begin(jobs_) + static_cast<std::ptrdiff_t>(n), std::back_inserter(batch));
+            jobs_.erase(std::begin(jobs_), std::begin(jobs_) + static_cast<std::ptrdiff_t>(n));
+            return true;
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                stopped_ = true;
+            }
+            cv_.notify_all();
+        }
+
+    private:
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        std::deque<job> jobs_;
+        bool stopped_{false};
+    };
+
+    void worker(job_queue &queue, statistics &stats, std::size_t batch_size, txtz::txtz const &z, txtz::adaptive_codec const *adaptive)
+    {
+        std::vector<job> batch;
+        batch.reserve(batch_size);
+        std::vector<uint8_t> compressed;
+        std::vector<char> decompressed;
+        while (queue.pop_batch(batch, batch_size))
+        {
+            stats.batches.fetch_add(1, std::memory_order_relaxed);
+            for (auto &j : batch)
+            {
+                std::vector<uint8_t> frame;
+                try
+                {
+                    switch (j.op)
+                    {
+                    case protocol::COMPRESS:
+                    {
+                        const std::string_view in(reinterpret_cast<char const *>(j.payload.data()), j.payload.size());
+                        std::size_t bits;
+                        std::size_t size;
+                        if (adaptive != nullptr)
+                        {
+                            compressed.resize(adaptive->compress_bound(in.size()));
+                            size = adaptive->compress(in, compressed.data(), compressed.size(), bits);
+                        }
+                        else
+                        {
+                            compressed.resize(z.compress_bound(in.size()));
+                            size = z.compress(in, compressed.data(), compressed.size(), bits);
+                        }
+                        protocol::append_frame(frame, protocol::OK, compressed.data(), size);
+                        break;
+                    }
+                    case protocol::DECOMPRESS:
+                    {
+                        if (adaptive != nullptr)
+                        {
+                            // the uncompressed size isn't known, so grow the buffer until the result fits
+                            const std::size_t max_size = 8 * j.payload.size() * adaptive->max_token_length();
+                            decompressed.resize(std::min(max_size, 4 * j.payload.size() + 64));
+                            for (;;)
+                            {
+                                try
+                                {
+                                    const std::size_t size = adaptive->decompress(j.payload.data(), j.payload.size(), decompressed.data(), decompressed.size());
+                                    protocol::append_frame(frame, protocol::OK, reinterpret_cast<uint8_t const *>(decompressed.data()), size);
+                                    break;
+                                }
+                                catch (std::length_error const &)
+                                {
+                                    if (decompressed.size() >= max_size)
+                                        throw;
+                                    decompressed.resize(std::min(max_size, 2 * decompressed.size()));
+                                }
+                            }
+                            break;
+                        }
+                        auto const &decompressed = z.decompress(j.payload);
+                        protocol::append_frame(frame, protocol::OK, reinterpret_cast<uint8_t const *>(decompressed.data()), decompressed.size());
+                        break;
+                    }
+                    case protocol::STATS:
+                    {
+                        stats.requests[protocol::STATS].fetch_add(1, std::memory_order_relaxed);
+                        auto const &report = stats.report();
+                        protocol::append_frame(frame, protocol::OK, reinterpret_cast<uint8_t const *>(report.data()), report.size());
+                        break;
+                    }
+                    default:
+                        throw std::invalid_argument("unknown request type");
+                    }
+                }
+                catch (std::exception const &e)
+                {
+                    stats.errors.fetch_add(1, std::memory_order_relaxed);
+                    frame.clear();
+                    protocol::append_frame(frame, protocol::ERROR, reinterpret_cast<uint8_t const *>(e.what()), std::strlen(e.what()));
+                }
+                if (j.op == protocol::COMPRESS || j.op == protocol::DECOMPRESS)
+                {
+                    stats.requests[j.op].fetch_add(1, std::memory_order_relaxed);
+                    stats.latency[j.op].record(clock_type::now() - j.received);
+                }
+                stats.bytes_in.fetch_add(j.payload.size(), std::memory_order_relaxed);
+                stats.bytes_out.fetch_add(frame.size(), std::memory_order_relaxed);
+                j.conn->complete(j.seq, std::move(frame));
+            }
+            batch.clear();
+        }
+    }
+
+    int shutdown_pipe[2] = {-1, -1};
+
+    void on_signal(int)
+    {
+        const char c = 0;
+        [[maybe_unused]] auto n = ::write(shutdown_pipe[1], &c, 1);
+    }
+
+    /**
+     * Parse complete frames in the connection's input buffer and queue them
+     * as jobs, as long as fewer than `max_in_flight` requests of the
+     * connection are in flight. The rest stays in the buffer.
+     *
+     * @return false if the input is malformed
+     */
+    bool dispatch(std::shared_ptr<connection> const &conn, job_queue &queue, std::size_t max_in_flight)
+    {
+        std::size_t consumed = 0;
+        try
+        {
+            while (conn->in_flight() < max_in_flight)
+            {
+                uint8_t type;
+                std::size_t payload_offset;
+                std::size_t payload_size;
+                const std::size_t frame_size = protocol::parse_frame(conn->in.data() + consumed, conn->in.size() - consumed, type, payload_offset, payload_size);
+                if (frame_size == 0)
+                    break;
+                auto const payload = std::begin(conn->in) + static_cast<std::ptrdiff_t>(consumed + payload_offset);
+                queue.push(job{conn, conn->next_request++, type, std::vector<uint8_t>(payload, payload + static_cast<std::ptrdiff_t>(payload_size)), clock_type::now()});
+                consumed += frame_size;
+            }
+        }
+        catch (std::length_error const &)
+        {
+            return false;
+        }
+        conn->in.erase(std::begin(conn->in), std::begin(conn->in) + static_cast<std::ptrdiff_t>(consumed));
+        return true;
+    }
+
+    void set_nonblocking(int fd)
+    {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    int serve(std::string const &socket_path, unsigned int num_workers, std::size_t batch_size, std::size_t max_in_flight, bool adapt, txtz::adaptive_codec::options const &adapt_options, std::size_t cache_size)
+    {
+        sockaddr_un addr{};
+        if (socket_path.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "\u001b[31;1mERROR: socket path too long.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        try
+        {
+            ::close(protocol::connect(socket_path));
+            std::cerr << "\u001b[31;1mERROR: another daemon is already listening on " << socket_path << ".\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        catch (std::runtime_error const &)
+        {
+            ::unlink(socket_path.c_str()); // stale socket file, if any
+        }
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+        const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || ::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd, SOMAXCONN) != 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: cannot listen on " << socket_path << ": " << std::strerror(errno) << "\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (::pipe(shutdown_pipe) != 0 || ::pipe(wakeup_pipe) != 0)
+        {
+            std::cerr << "\u001b[31;1mERROR: " << std::strerror(errno) << "\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        set_nonblocking(wakeup_pipe[0]);
+        set_nonblocking(wakeup_pipe[1]);
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+
+        std::unique_ptr<txtz::adaptive_codec> adaptive;
+        if (adapt)
+        {
+            try
+            {
+                adaptive = std::make_unique<txtz::adaptive_codec>(txtz::compression_table, txtz::compression_table_normalization, adapt_options);
+            }
+            catch (std::exception const &e)
+            {
+                std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+                return EXIT_FAILURE;
+            }
+        }
+        // one dictionary, and optionally one cache, shared by all workers
+        std::shared_ptr<txtz::memo_cache> cache;
+        if (cache_size > 0)
+        {
+            cache = std::make_shared<txtz::memo_cache>(cache_size);
+        }
+        const txtz::txtz generic(txtz::compression_table, txtz::compression_table_normalization, txtz::compression_table_specialization);
+        const txtz::txtz z(generic.shared_dictionary(), cache);
+        statistics stats;
+        stats.adaptive = adaptive.get();
+        stats.cache = cache.get();
+        job_queue queue;
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < num_workers; ++i)
+        {
+            workers.emplace_back(worker, std::ref(queue), std::ref(stats), batch_size, std::cref(z), adaptive.get());
+        }
+        std::cout << "txtzd listening on " << socket_path << " with " << num_workers << " workers\n"
+                  << std::flush;
+
+        std::unordered_map<int, std::shared_ptr<connection>> connections;
+        std::vector<pollfd> fds;
+        std::vector<uint8_t> buf(64 * 1024);
+        bool running = true;
+        auto stop_reading = [](connection &conn)
+        {
+            ::shutdown(conn.fd(), SHUT_RD);
+            conn.reading = false;
+            conn.in.clear();
+        };
+        while (running)
+        {
+            fds.clear();
+            fds.push_back(pollfd{shutdown_pipe[0], POLLIN, 0});
+            fds.push_back(pollfd{wakeup_pipe[0], POLLIN, 0});
+            fds.push_back(pollfd{listen_fd, POLLIN, 0});
+            for (auto it = std::begin(connections); it != std::end(connections);)
+            {
+                auto &conn = *it->second;
+                if (!conn.flush())
+                {
+                    // peer went away; workers may still hold the connection, so it is closed when they're done
+                    it = connections.erase(it);
+                    continue;
+                }
+                // sent responses make room for requests that are already buffered
+                if (conn.reading && !dispatch(it->second, queue, max_in_flight))
+                {
+                    stop_reading(conn);
+                }
+                if (!conn.reading && conn.in_flight() == 0)
+                {
+                    it = connections.erase(it);
+                    continue;
+                }
+                // a client that is too far ahead isn't read from until it has received its responses
+                const short events = static_cast<short>((conn.reading && conn.in_flight() < max_in_flight ? POLLIN : 0) | (conn.has_output() ? POLLOUT : 0));
+                if (events != 0) // otherwise a hangup would be reported over and over while the workers are busy
+                {
+                    fds.push_back(pollfd{it->first, events, 0});
+                }
+                ++it;
+            }
+            if (::poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[0].revents != 0)
+            {
+                running = false;
+                continue;
+            }
+            if ((fds[1].revents & POLLIN) != 0)
+            {
+                char drain[256];
+                while (::read(wakeup_pipe[0], drain, sizeof(drain)) > 0)
+                {
+                }
+            }
+            if ((fds[2].revents & POLLIN) != 0)
+            {
+                const int fd = ::accept(listen_fd, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    set_nonblocking(fd);
+                    connections.emplace(fd, std::make_shared<connection>(fd));
+                    stats.connections.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            for (std::size_t i = 3; i < fds.size(); ++i)
+            {
+                if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+                    continue;
+                auto const &conn = connections.at(fds[i].fd);
+                if (!conn->reading)
+                    continue;
+                const ssize_t n = ::recv(fds[i].fd, buf.data(), buf.size(), 0);
+                if (n > 0)
+                {
+                    conn->in.insert(std::end(conn->in), std::begin(buf), std::begin(buf) + n);
+                    if (dispatch(conn, queue, max_in_flight))
+                        continue;
+                }
+                else if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    continue;
+                }
+                // peer closed the connection or sent garbage; the connection
+                // is dropped as soon as the last pending response has been sent
+                stop_reading(*conn);
+            }
+        }
+
+        queue.stop();
+        for (auto &w : workers)
+        {
+            w.join();
+        }
+        for (auto const &c : connections)
+        {
+            c.second->flush(); // whatever fits into the socket buffer
+        }
+        connections.clear();
+        ::close(listen_fd);
+        ::unlink(socket_path.c_str());
+        std::cout << "\n"
+                  << stats.report();
+        return EXIT_SUCCESS;
+    }
+
+    int request(std::string const &socket_path, uint8_t op, std::vector<uint8_t> const &payload, std::ostream &out)
+    {
+        const int fd = protocol::connect(socket_path);
+        std::vector<uint8_t> frame;
+        protocol::append_frame(frame, op, payload.data(), payload.size());
+        uint8_t status;
+        std::vector<uint8_t> response;
+        const bool ok = protocol::send_all(fd, frame.data(), frame.size()) && protocol::receive_frame(fd, status, response);
+        ::close(fd);
+        if (!ok)
+        {
+            std::cerr << "\u001b[31;1mERROR: connection to daemon lost.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        if (status != protocol::OK)
+        {
+            std::cerr << "\u001b[31;1mERROR: " << std::string(std::begin(response), std::end(response)) << "\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        out.write(reinterpret_cast<char const *>(response.data()), static_cast<std::streamsize>(response.size()));
+        return EXIT_SUCCESS;
+    }
+
+    /**
+     * Send all `requests` over one connection without waiting for responses,
+     * which are collected concurrently.
+     *
+     * @return false if the connection broke down or a request failed
+     */
+    bool pipeline(int fd, uint8_t op, std::vector<std::vector<uint8_t>> const &requests, std::vector<std::vector<uint8_t>> &responses)
+    {
+        std::thread sender([fd, op, &requests]
+                           {
+            std::vector<uint8_t> frames;
+            for (auto const &r : requests)
+            {
+                protocol::append_frame(frames, op, r.data(), r.size());
+                if (frames.size() >= 64 * 1024)
+                {
+                    protocol::send_all(fd, frames.data(), frames.size());
+                    frames.clear();
+                }
+            }
+            protocol::send_all(fd, frames.data(), frames.size()); });
+        bool ok = true;
+        responses.resize(requests.size());
+        for (auto &r : responses)
+        {
+            uint8_t status;
+            if (!protocol::receive_frame(fd, status, r) || status != protocol::OK)
+            {
+                ok = false;
+                break;
+            }
+        }
+        sender.join();
+        return ok;
+    }
+
+    /**
+     * Compress every line of the input through the daemon, decompress the
+     * results through the daemon and compare them with the original lines.
+     */
+    int roundtrip(std::string const &socket_path, std::istream &in)
+    {
+        std::vector<std::vector<uint8_t>> lines;
+        std::string line;
+        while (std::getline(in, line))
+        {
+            line.erase(std::remove(std::begin(line), std::end(line), '\r'), std::end(line));
+            lines.emplace_back(std::begin(line), std::end(line));
+        }
+        const int fd = protocol::connect(socket_path);
+        std::vector<std::vector<uint8_t>> compressed;
+        std::vector<std::vector<uint8_t>> decompressed;
+        const auto t0 = clock_type::now();
+        bool ok = pipeline(fd, protocol::COMPRESS, lines, compressed);
+        const auto t1 = clock_type::now();
+        ok = ok && pipeline(fd, protocol::DECOMPRESS, compressed, decompressed);
+        const auto t2 = clock_type::now();
+        ::close(fd);
+        if (!ok)
+        {
+            std::cerr << "\u001b[31;1mERROR: request failed.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+        std::size_t mismatches = 0;
+        for (std::size_t i = 0; i < lines.size(); ++i)
+        {
+            if (lines[i] != decompressed[i])
+            {
+                ++mismatches;
+            }
+        }
+        auto rate = [&lines](clock_type::duration d)
+        {
+            return double(lines.size()) / std::chrono::duration<double>(d).count();
+        };
+        std::cout << lines.size() << " strings, " << mismatches << " mismatches\n"
+                  << "compress:   " << std::fixed << std::setprecision(0) << rate(t1 - t0) << " requests/s\n"
+                  << "decompress: " << rate(t2 - t1) << " requests/s\n";
+        return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    using argparser = argparser::argparser;
+    argparser opt(argc, argv);
+    opmode_t op = SERVE;
+    std::string socket_path = "/tmp/txtzd.sock";
+    unsigned int num_workers = std::max(1U, std::thread::hardware_concurrency());
+    std::size_t batch_size = 64;
+    std::size_t max_in_flight = 1024;
+    std::string input_filename;
+    bool adapt = false;
+    txtz::adaptive_codec::options adapt_options;
+    std::size_t cache_size = 0;
+    opt
+        .info("txtz daemon", argv[0])
+        .help({"-?", "--help"}, "Display this help")
+        .reg({"-s", "--socket"}, "SOCKET_PATH", argparser::required_argument, "Unix domain socket to listen on or connect to (default: \"" + socket_path + "\")", [&socket_path](std::string const &arg)
+             { socket_path = arg; })
+        .reg({"-w", "--workers"}, "N", argparser::required_argument, "Number of worker threads (default: number of cores)", [&num_workers](std::string const &arg)
+             { num_workers = static_cast<unsigned int>(std::max(1UL, std::stoul(arg))); })
+        .reg({"-b", "--batch-size"}, "N", argparser::required_argument, "Maximum number of requests a worker takes from the queue at once (default: 64)", [&batch_size](std::string const &arg)
+             { batch_size = std::max(1UL, std::stoul(arg)); })
+        .reg({"--max-in-flight"}, "N", argparser::required_argument, "Stop reading from a client with N requests whose responses it hasn't received yet (default: 1024)", [&max_in_flight](std::string const &arg)
+             { max_in_flight = std::max(1UL, std::stoul(arg)); })
+        .reg({"--adapt"}, argparser::no_argument, "Retrain the dictionary from sampled input while running; compressed data then starts with the dictionary version (requires --state-dir)", [&adapt](std::string const &)
+             { adapt = true; })
+        .reg({"--sample-every"}, "N", argparser::required_argument, "With --adapt: sample one out of N strings (default: 16)", [&adapt_options](std::string const &arg)
+             { adapt_options.sample_every = std::stoul(arg); })
+        .reg({"--retrain-after"}, "N", argparser::required_argument, "With --adapt: retrain after N samples (default: 10000)", [&adapt_options](std::string const &arg)
+             { adapt_options.retrain_after = std::max(1UL, std::stoul(arg)); })
+        .reg({"--state-dir"}, "DIR", argparser::required_argument, "With --adapt: keep retrained dictionaries in DIR, so that data compressed with them stays decodable after a restart (required)", [&adapt_options](std::string const &arg)
+             { adapt_options.state_dir = arg; })
+        .reg({"--cache"}, "BYTES", argparser::required_argument, "Memoize the results of up to BYTES bytes of frequent requests (default: 0, i.e. off; not with --adapt)", [&cache_size](std::string const &arg)
+             { cache_size = std::stoul(arg); })
+        .reg({"-c", "--compress"}, argparser::no_argument, "Client: let a running daemon compress the input", [&op](std::string const &)
+             { op = CLIENT_COMPRESS; })
+        .reg({"-d", "--decompress"}, argparser::no_argument, "Client: let a running daemon decompress the input", [&op](std::string const &)
+             { op = CLIENT_DECOMPRESS; })
+        .reg({"--stats"}, argparser::no_argument, "Client: print request counters and latency histograms of a running daemon", [&op](std::string const &)
+             { op = CLIENT_STATS; })
+        .reg({"--roundtrip"}, argparser::no_argument, "Client: compress and decompress each line of the input through a running daemon and verify the result", [&op](std::string const &)
+             { op = CLIENT_ROUNDTRIP; })
+        .reg({"-i", "--input-file"}, "INPUT_FILENAME", argparser::required_argument, "Client: input file (default: stdin)", [&input_filename](std::string const &arg)
+             { input_filename = arg; });
+    try
+    {
+        opt();
+    }
+    catch (::argparser::help_requested_exception const &)
+    {
+        return EXIT_SUCCESS;
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (adapt && cache_size > 0)
+    {
+        std::cerr << "\u001b[31;1mERROR: --cache cannot be combined with --adapt.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (adapt && adapt_options.state_dir.empty())
+    {
+        std::cerr << "\u001b[31;1mERROR: --adapt requires --state-dir, or data compressed with retrained dictionaries can't be decompressed after a restart.\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    if (op == SERVE)
+        return serve(socket_path, num_workers, batch_size, max_in_flight, adapt, adapt_options, cache_size);
+
+    std::ifstream file_in;
+    if (!input_filename.empty())
+    {
+        file_in.open(input_filename, std::ios::binary);
+        if (!file_in)
+        {
+            std::cerr << "\u001b[31;1mERROR: input file '" << input_filename << "' doesn't exist.\u001b[0m\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::istream &in = input_filename.empty() ? std::cin : file_in;
+    try
+    {
+        switch (op)
+        {
+        case CLIENT_COMPRESS:
+        case CLIENT_DECOMPRESS:
+        {
+            std::vector<uint8_t> payload(std::istreambuf_iterator<char>(in), {});
+            return request(socket_path, op == CLIENT_COMPRESS ? protocol::COMPRESS : protocol::DECOMPRESS, payload, std::cout);
+        }
+        case CLIENT_STATS:
+            return request(socket_path, protocol::STATS, {}, std::cout);
+        case CLIENT_ROUNDTRIP:
+            return roundtrip(socket_path, in);
+        case SERVE: // handled above
+            break;
+        }
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "\u001b[31;1mERROR: " << e.what() << "\u001b[0m\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
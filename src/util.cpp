@@ -84,4 +84,53 @@ namespace util
         return strings;
     }
 
-}
\ No newline at end of file
+    void append_varint(std::vector<uint8_t> &out, std::size_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    std::size_t write_varint(uint8_t *out, std::size_t capacity, std::size_t value)
+    {
+        std::size_t i = 0;
+        while (value >= 0x80)
+        {
+            if (i == capacity)
+                return 0;
+            out[i++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        if (i == capacity)
+            return 0;
+        out[i++] = static_cast<uint8_t>(value);
+        return i;
+    }
+
+    std::size_t varint_size(std::size_t value)
+    {
+        std::size_t n = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+    std::size_t read_varint(uint8_t const *data, std::size_t size, std::size_t &value)
+    {
+        value = 0;
+        for (std::size_t i = 0; i < size && 7 * i < 8 * sizeof(std::size_t); ++i)
+        {
+            value |= static_cast<std::size_t>(data[i] & 0x7f) << (7 * i);
+            if ((data[i] & 0x80) == 0)
+                return i + 1;
+        }
+        return 0;
+    }
+
+}
@@ -28,6 +28,8 @@
 #ifndef __UTIL_HPP__
 #define __UTIL_HPP__
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <utility>
@@ -39,6 +41,31 @@ namespace util
     std::vector<std::string> split(const std::string &str, char delim);
     std::pair<std::string, std::string> unpair(const std::string &str, char delim);
 
+    /**
+     * Append `value` to `out` as an unsigned LEB128 varint, i.e. seven bits
+     * per byte, least significant group first, MSB set on all but the last byte.
+     */
+    void append_varint(std::vector<uint8_t> &out, std::size_t value);
+
+    /**
+     * Write `value` as an unsigned LEB128 varint to the `capacity` bytes at `out`.
+     *
+     * @return number of bytes written, or 0 if `capacity` doesn't suffice
+     */
+    std::size_t write_varint(uint8_t *out, std::size_t capacity, std::size_t value);
+
+    /**
+     * @return number of bytes `value` occupies as an unsigned LEB128 varint
+     */
+    std::size_t varint_size(std::size_t value);
+
+    /**
+     * Read an unsigned LEB128 varint from the `size` bytes at `data`.
+     *
+     * @return number of bytes consumed, or 0 if the varint is truncated or overlong
+     */
+    std::size_t read_varint(uint8_t const *data, std::size_t size, std::size_t &value);
+
     template <typename InputIteratorT, typename SeparatorT>
     std::string join(InputIteratorT input, SeparatorT separator)
     {